@@ -0,0 +1,269 @@
+// End-to-end load generator: starts one chatserver per line of the config
+// file, joins many UDP clients to the rooms, sends paced chat lines that
+// carry their send time and checks what comes back.
+// Prints one line: mode clients rooms sent expected delivered msgs_per_s
+// deliveries_per_s p50_us p99_us p999_us max_us fifo_violations total_violations
+// usage: ./chatbench [-o unordered|fifo|total|sequencer] [-c clients] [-r rooms]
+//                    [-R msgs/s] [-d seconds] [-s server] [-x "server args"] config.txt
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <algorithm>
+#include "cs_metrics.h"
+#include "cs_check.h"
+
+#define BENCH_RCVBUF (256 << 10)
+#define BENCH_DRAIN_MS 1000 // keep receiving this long after the last send
+
+struct benchClient : deliveryLog {
+    int fd;
+    int server;
+    int seq; // last message number sent
+};
+
+static vector<benchClient> users; // cs_common.h declares the server's clients
+static vector<struct sockaddr_in> servers;
+static vector<pid_t> children;
+static long latency[HIST_BUCKETS];
+static long delivered = 0, fifoViolations = 0;
+static uint64_t maxLatency = 0;
+
+void throwSysError(const char *msg) {
+    perror(msg);
+    exit(1);
+}
+
+void throwMyError(const char *msg) {
+    printf("%s\n", msg);
+    exit(1);
+}
+
+static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t percentile(double q) {
+    long want = (long) (q * delivered + 0.999999), seen = 0;
+    for (int b = 0; b < HIST_BUCKETS && delivered > 0; b++) {
+        seen += latency[b];
+        if (seen >= want) return min(maxLatency, hist_bucketTop(b));
+    }
+    return 0;
+}
+
+// client address of every server, the part before the comma
+static void readConfig(const char *filename) {
+    ifstream infile(filename);
+    string line;
+    while (getline(infile, line)) {
+        if (line.empty()) continue;
+        string fwd = line.substr(0, line.find(","));
+        int col = fwd.find(":");
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(fwd.substr(col + 1).c_str()));
+        if (inet_pton(AF_INET, fwd.substr(0, col).c_str(), &addr.sin_addr) != 1) {
+            throwMyError("Bad server address in config file");
+        }
+        servers.push_back(addr);
+    }
+    if (servers.empty()) throwMyError("No servers in config file");
+}
+
+static void startServers(const char *server, const char *mode, string const &extra,
+                         const char *config) {
+    for (int i = 0; i < servers.size(); i++) {
+        vector<string> args;
+        args.push_back(server);
+        args.push_back("-o");
+        args.push_back(mode);
+        istringstream words(extra);
+        string word;
+        while (words >> word) args.push_back(word);
+        args.push_back(config);
+        args.push_back(to_string(i + 1));
+        pid_t pid = fork();
+        if (pid < 0) throwSysError("fork failed");
+        if (pid == 0) {
+            children.clear(); // not ours to stop
+            vector<char*> argv;
+            for (int j = 0; j < args.size(); j++) argv.push_back((char*) args[j].c_str());
+            argv.push_back(NULL);
+            execv(server, argv.data());
+            throwSysError("Failed to start server");
+        }
+        children.push_back(pid);
+    }
+    usleep(300000); // let them bind
+}
+
+// also runs at exit, so an error after the servers started does not leave them holding the ports
+static void stopServers() {
+    for (int i = 0; i < children.size(); i++) kill(children[i], SIGTERM);
+    for (int i = 0; i < children.size(); i++) waitpid(children[i], NULL, 0);
+    children.clear();
+}
+
+// every client gets its own socket, joins room i % rooms + 1 on server i % N
+static void joinClients(int count, int rooms, int epfd) {
+    struct rlimit lim;
+    getrlimit(RLIMIT_NOFILE, &lim);
+    lim.rlim_cur = lim.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &lim);
+    users.resize(count);
+    for (int i = 0; i < count; i++) {
+        benchClient &c = users[i];
+        c.fd = socket(PF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if (c.fd < 0) throwSysError("Failed to create socket (raise ulimit -n?)");
+        int rcvbuf = BENCH_RCVBUF;
+        setsockopt(c.fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        c.server = i % servers.size();
+        c.room = i % rooms + 1;
+        c.seq = 0;
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = i;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, c.fd, &ev);
+        string join = "/join " + to_string(c.room);
+        sendto(c.fd, join.data(), join.size(), 0, (struct sockaddr*) &servers[c.server],
+               sizeof(servers[c.server]));
+    }
+    // wait for every +OK
+    int joined = 0;
+    uint64_t deadline = nowNs() + 5000000000ULL;
+    struct epoll_event events[256];
+    char buf[256];
+    while (joined < count && nowNs() < deadline) {
+        int n = epoll_wait(epfd, events, 256, 100);
+        for (int e = 0; e < n; e++) {
+            benchClient &c = users[events[e].data.u32];
+            while (recv(c.fd, buf, sizeof(buf), 0) > 0) joined++;
+        }
+    }
+    if (joined < count) throwMyError("Not every client could join");
+}
+
+// "<nick> B <sender> <seq> <sent ns>"
+static void onDelivery(benchClient &c, const char *buf, int len, uint64_t now) {
+    int sender, seq;
+    uint64_t sent;
+    if (!check_parse(buf, len, 'B', sender, seq, sent)) return;
+    uint64_t us = (now - sent) / 1000;
+    latency[hist_bucket(us)]++;
+    maxLatency = max(maxLatency, us);
+    delivered++;
+    if (!check_delivered(c, sender, seq)) fifoViolations++;
+}
+
+static void receive(int epfd, int timeoutMs) {
+    static char buf[65536];
+    struct epoll_event events[256];
+    int n = epoll_wait(epfd, events, 256, timeoutMs);
+    uint64_t now = nowNs();
+    for (int e = 0; e < n; e++) {
+        benchClient &c = users[events[e].data.u32];
+        int len;
+        while ((len = recv(c.fd, buf, sizeof(buf) - 1, 0)) > 0) {
+            buf[len] = 0;
+            onDelivery(c, buf, len, now);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *mode = "unordered";
+    const char *server = "./chatserver";
+    string extra;
+    int count = 100, rooms = 10, seconds = 5;
+    long rate = 1000;
+    int c;
+    while ((c = getopt(argc, argv, "o:c:r:R:d:s:x:")) != -1) {
+        switch (c) {
+        case 'o': mode = optarg; break;
+        case 'c': count = atoi(optarg); break;
+        case 'r': rooms = atoi(optarg); break;
+        case 'R': rate = atol(optarg); break;
+        case 'd': seconds = atoi(optarg); break;
+        case 's': server = optarg; break;
+        case 'x': extra = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-o mode] [-c clients] [-r rooms] [-R msgs/s] "
+                    "[-d seconds] [-s server] [-x \"server args\"] config.txt\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (optind >= argc) throwMyError("Config file missing");
+    if (count < 1 || rooms < 1 || rate < 1 || seconds < 1) throwMyError("Bad parameters");
+    rooms = min(rooms, count);
+    signal(SIGPIPE, SIG_IGN);
+
+    readConfig(argv[optind]);
+    atexit(stopServers);
+    startServers(server, mode, extra, argv[optind]);
+    int epfd = epoll_create1(0);
+    joinClients(count, rooms, epfd);
+
+    // paced sending: whatever is due by now goes out, round robin over the clients.
+    // a send the client's socket has no room for is tried again next round
+    long sent = 0, expected = 0;
+    vector<long> roomSize(rooms + 1, 0);
+    for (int i = 0; i < count; i++) roomSize[users[i].room]++;
+    char line[128];
+    uint64_t start = nowNs(), end = start + (uint64_t) seconds * 1000000000;
+    int next = 0;
+    while (true) {
+        uint64_t now = nowNs();
+        if (now >= end) break;
+        long due = (long) ((now - start) / 1e9 * rate) - sent;
+        for (long k = 0; k < due; k++) {
+            benchClient &s = users[next];
+            int len = snprintf(line, sizeof(line), "B %d %d %llu", next, s.seq + 1,
+                               (unsigned long long) nowNs());
+            if (sendto(s.fd, line, len, 0, (struct sockaddr*) &servers[s.server],
+                       sizeof(servers[s.server])) < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) break;
+                throwSysError("Error sending packet");
+            }
+            s.seq++;
+            sent++;
+            expected += roomSize[s.room];
+            next = (next + 1) % count;
+        }
+        receive(epfd, 1);
+    }
+    double sendTime = (nowNs() - start) / 1e9;
+    uint64_t drainEnd = nowNs() + BENCH_DRAIN_MS * 1000000ULL;
+    while (nowNs() < drainEnd && delivered < expected) receive(epfd, 10);
+    double elapsed = (nowNs() - start) / 1e9;
+    stopServers();
+
+    vector<deliveryLog*> logs;
+    for (int i = 0; i < count; i++) logs.push_back(&users[i]);
+    long totalBad = (strcmp(mode, "total") == 0 || strcmp(mode, "sequencer") == 0) ?
+                    check_totalViolations(logs, rooms) : 0;
+    printf("mode clients rooms sent expected delivered msgs_per_s deliveries_per_s "
+           "p50_us p99_us p999_us max_us fifo_violations total_violations\n");
+    printf("%s %d %d %ld %ld %ld %.0f %.0f %llu %llu %llu %llu %ld %ld\n", mode, count, rooms,
+           sent, expected, delivered, sent / sendTime, delivered / elapsed,
+           (unsigned long long) percentile(0.50), (unsigned long long) percentile(0.99),
+           (unsigned long long) percentile(0.999), (unsigned long long) maxLatency,
+           strcmp(mode, "unordered") == 0 ? 0 : fifoViolations, totalBad);
+    return 0;
+}
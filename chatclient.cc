@@ -5,8 +5,12 @@
 #include <string.h>
 #include <arpa/inet.h>
 #include <sys/select.h>
+#include <time.h>
 
 using namespace std;
+
+#define MSG_MAXSIZE 65507 // largest UDP datagram
+#define KEEPALIVE_S 30 // an empty datagram when we sent nothing for this long, keeps the session
 void verbatim(const char *prefix, const char *data, int len, const char *suffix);
 
 void throwSysError(const char *msg) {
@@ -62,47 +66,65 @@ int main(int argc, char *argv[])
         // << ":" << ntohs(dest.sin_port) << endl;
 
     
-    char buffer[100];
-    char sbuffer[100];
-    bzero(buffer, sizeof(buffer));
-    bzero(sbuffer, sizeof(sbuffer));
+    // input lines and server messages may be as large as a UDP datagram
+    static char buffer[MSG_MAXSIZE + 1];
+    static char sbuffer[MSG_MAXSIZE + 1];
+    int used = 0; // bytes of buffer holding an unfinished line
+    bool inputOpen = true;
     
     struct sockaddr_in src; // should be same as dest
     socklen_t srcSize = sizeof(src);
+    time_t lastSent = time(NULL);
 
     while (true) {
+        if (time(NULL) - lastSent >= KEEPALIVE_S) {
+            status = sendto(sockfd, "", 0, 0, (struct sockaddr*) &dest, sizeof(dest));
+            if (status < 0) throwSysError("Error sending packet");
+            lastSent = time(NULL);
+        }
+        struct timeval timeout = { KEEPALIVE_S, 0 };
         
         fd_set readfds;
         FD_ZERO(&readfds);
         FD_SET(sockfd, &readfds);
-        FD_SET(STDIN_FILENO, &readfds);
+        if (inputOpen) FD_SET(STDIN_FILENO, &readfds);
         int nfds = sockfd + 1;
 
         // there is something to read 
-        if (select(nfds, &readfds, NULL, NULL, NULL) > 0) {
+        if (select(nfds, &readfds, NULL, NULL, &timeout) > 0) {
 
             // read from server
             if (FD_ISSET(sockfd, &readfds)) {
                 int rlen = recvfrom(sockfd, sbuffer, sizeof(sbuffer)-1, 0,
                                 (struct sockaddr*)&src, &srcSize);
+                if (rlen < 0) continue;
+                sbuffer[rlen] = 0;
                 printf("%s\n", sbuffer);
-                bzero(sbuffer, sizeof(sbuffer));
             } 
             
             // read from user input 
             else if (FD_ISSET(STDIN_FILENO, &readfds)) {
-                // read from user input and send to server
-                while (read(STDIN_FILENO, buffer, sizeof(buffer)) > 0) {
-                    status = sendto(sockfd, buffer, strlen(buffer)-1, 0, 
+                int rlen = read(STDIN_FILENO, buffer + used, MSG_MAXSIZE - used);
+                if (rlen <= 0) { // keep printing what the server sends
+                    inputOpen = false;
+                    continue;
+                }
+                used += rlen;
+                // send every complete line, a line filling the whole buffer goes as it is
+                char *start = buffer, *end = buffer + used;
+                while (start < end) {
+                    char *nl = (char*) memchr(start, '\n', end - start);
+                    if (nl == NULL && !(start == buffer && used == MSG_MAXSIZE)) break;
+                    int len = (nl != NULL) ? nl - start : end - start;
+                    status = sendto(sockfd, start, len, 0, 
                                     (struct sockaddr*) &dest, sizeof(dest));
-                    string msg(buffer);
-                    bzero(buffer,strlen(buffer));
                     if (status < 0) throwSysError("Error sending packet");
-                    else { 
-                        if (msg.substr(0,5) == "/quit") return 0;
-                        else break; 
-                    }
+                    lastSent = time(NULL);
+                    if (len >= 5 && strncmp(start, "/quit", 5) == 0) return 0;
+                    start += (nl != NULL) ? len + 1 : len;
                 }
+                used = end - start;
+                memmove(buffer, start, used);
             }
         }
     }
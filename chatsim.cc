@@ -0,0 +1,548 @@
+// Deterministic network simulator: runs N virtual servers in one process,
+// each with the server's own packet handling and ordering code, behind a
+// transport that hands datagrams to a discrete-event network instead of the
+// kernel. Server links have latency, jitter, drop and reorder; client links
+// only a fixed delay. With -E a server's socket buffer holds that many
+// datagrams and empties at one per -D microseconds; a send finds it full
+// (EAGAIN, or fewer datagrams taken than offered) and the rest waits in the
+// server's send queues until the buffer is half empty. Time is virtual and
+// handling a datagram takes none of it, so a run takes as long as the work
+// and load only shows where a protocol waits (total ordering window).
+// Prints one line per (mode, servers, rate): mode servers clients rooms rate
+// sent expected delivered peer_datagrams busiest_out dropped datagrams_per_delivery
+// p50_us p99_us max_us fifo_violations total_violations queued queue_dropped queue_max
+// fifo_held (datagrams that waited in send queues, dropped from full ones,
+// most waiting on one server at once; FIFO messages still waiting for a gap
+// at the end). Exits 1 if a run saw order violations, or messages left
+// waiting for a gap when no chat line was lost (no -p, no queue drops).
+// -P drops only interest announcements and digests (-I), so their loss
+// can be tried without losing any chat lines.
+// With -C, clients leave their room and join it again while messages flow
+// (and send nothing while away); expected then counts them as members
+// throughout, and a message missing in the middle of a membership counts as
+// a fifo or total violation, so such runs are meant to lose nothing (no -p,
+// no send queue drops).
+// usage: ./chatsim [-o modes] [-n servers] [-c clients] [-r rooms] [-m msgs]
+//                  [-R msgs/s] [-l latency_us] [-j jitter_us] [-p drop%] [-P interest drop%]
+//                  [-q reorder%] [-S slow_us] [-W window] [-B batch] [-w binary|text]
+//                  [-k off|delay_us] [-K bundle bytes] [-T relay degree] [-I] [-G]
+//                  [-C part/join cycles] [-E socket datagrams] [-D us per datagram]
+//                  [-Q queue limit] [-s seed] [-v]
+// -o, -n and -R take comma separated lists, every combination is run
+#include "cs_server.h"
+#include "cs_order.h"
+#include "cs_ingest.h"
+#include "cs_index.h"
+#include "cs_transport.h"
+#include "cs_metrics.h"
+#include "cs_frag.h"
+#include "cs_shard.h"
+#include "cs_fanout.h"
+#include "cs_coalesce.h"
+#include "cs_relay.h"
+#include "cs_interest.h"
+#include "cs_group.h"
+#include "cs_check.h"
+#include "cs_sendq.h"
+#include <errno.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include <sstream>
+
+// what chatserver.cc defines for the server
+thread_local int sockfd;
+int nn;
+int N;
+int debug_mode = 0;
+vector<address> forwAddresses;
+vector<struct sockaddr_in> peerDests;
+
+#define SIM_PEER_NET 0x0a000000 // servers are 10.0.0.x:5000
+#define SIM_CLIENT_NET 0x0a010000 // clients are 10.1.x.x:6000
+#define SIM_CLIENT_US 50 // one-way delay between a client and its server
+#define SIM_JOIN_US 10000 // clients join before the first message
+#define SIM_AWAY_US 100000 // a client that parts (-C) joins again this much later
+
+#define SIM_TO_SERVER 0
+#define SIM_TO_CLIENT 1
+#define SIM_FLUSH 2 // coalescing delay of a server is up
+#define SIM_TICK 3 // a server's periodic housekeeping, as onTick in chatserver.cc
+#define SIM_TICK_US 1000000
+#define SIM_WRITABLE 4 // a server's socket buffer has room again
+#define SIM_WIRE_US 20 // -E: a datagram leaves the socket buffer this much after the one before
+
+struct simEvent {
+    uint64_t at;
+    uint64_t seq; // events due at the same time run in scheduling order
+    int kind;
+    int target; // server or client index
+    address src;
+    string bytes;
+};
+
+struct simLater {
+    bool operator()(simEvent const *a, simEvent const *b) const {
+        return tie(a->at, a->seq) > tie(b->at, b->seq);
+    }
+};
+
+// a virtual server runs on its own thread, so every thread_local of the
+// server code is its own; the scheduler runs one of them at a time
+struct simServer {
+    thread worker;
+    condition_variable wake;
+    bool busy; // has a datagram to handle, or bundles to flush
+    bool flush;
+    bool tick;
+    bool bundled; // bundles wait for a flush
+    bool flushDue; // SIM_FLUSH scheduled
+    bool writable;
+    bool waiting; // datagrams wait in its send queues
+    bool writableDue; // SIM_WRITABLE scheduled
+    uint64_t linkFree; // -E: when the last datagram in the socket buffer leaves
+    metrics *mt;
+    deque<pair<address,string> > inbox;
+    vector<struct sockaddr_in> peers;
+};
+
+struct simClient : deliveryLog {
+    address addr;
+    int server;
+    int seq; // last message number sent
+};
+
+struct simConfig {
+    int clients, rooms, msgs;
+    int churn; // part/join cycles over the run
+    int latencyUs, jitterUs;
+    int slowUs; // extra delay on every link of the last server
+    int sockBuf; // datagrams a server's socket buffer holds, 0: never full
+    int wireUs; // time a datagram takes to leave it
+    double drop, reorder; // percent of server datagrams
+    double interestDrop; // percent of WIRE_INTEREST datagrams
+};
+
+static simConfig cfg;
+static mutex simLock;
+static condition_variable simDone;
+static bool stopping;
+static int current; // server whose code is running
+static uint64_t now, nextSeq;
+static mt19937 rng;
+static priority_queue<simEvent*, vector<simEvent*>, simLater> events;
+static vector<simServer*> servers;
+static vector<simClient> users; // the server has its own clients
+static map<address,int> serverIndex, clientIndex;
+static long peerDatagrams, dropped, delivered, fifoViolations;
+static bool violated; // some run saw an order violation
+static uint64_t ticksEnd; // servers tick until the clients are done sending
+static vector<long> serverOut; // server datagrams each server sent
+static vector<uint64_t> latencies;
+
+static thread_local ingestSlab simSlab;
+
+static void schedule(uint64_t at, int kind, int target, address src, string const &bytes) {
+    simEvent *e = new simEvent();
+    e->at = at;
+    e->seq = nextSeq++;
+    e->kind = kind;
+    e->target = target;
+    e->src = src;
+    e->bytes = bytes;
+    events.push(e);
+}
+
+static bool chance(double percent) {
+    return percent > 0 && rng() % 1000000 < percent * 10000;
+}
+
+static bool isInterest(string const &bytes) {
+    return bytes.size() >= WIRE_HEADER && (unsigned char) bytes[0] == WIRE_MAGIC && bytes[2] == WIRE_INTEREST;
+}
+
+// transport: called from a server thread while the scheduler waits
+static int simSend(int fd, struct mmsghdr *msgs, unsigned int count, int flags) {
+    simServer &s = *servers[current];
+    for (unsigned int i = 0; i < count; i++) {
+        uint64_t leave = now;
+        if (cfg.sockBuf > 0) {
+            // full: takes what fit so far, or none at all
+            if (s.linkFree > now + (uint64_t) (cfg.sockBuf - 1) * cfg.wireUs) {
+                if (i > 0) return i;
+                errno = EAGAIN;
+                return -1;
+            }
+            s.linkFree = max(s.linkFree, now) + cfg.wireUs;
+            leave = s.linkFree;
+        }
+        struct msghdr &hdr = msgs[i].msg_hdr;
+        string bytes;
+        for (int j = 0; j < hdr.msg_iovlen; j++) {
+            bytes.append((char*) hdr.msg_iov[j].iov_base, hdr.msg_iov[j].iov_len);
+        }
+        msgs[i].msg_len = bytes.size();
+        address to = toAddress(*(struct sockaddr_in*) hdr.msg_name);
+        map<address,int>::iterator it = serverIndex.find(to);
+        if (it != serverIndex.end()) {
+            peerDatagrams++;
+            serverOut[current]++;
+            if (chance(cfg.drop) || (isInterest(bytes) && chance(cfg.interestDrop))) {
+                dropped++;
+                continue;
+            }
+            uint64_t delay = cfg.latencyUs + (cfg.jitterUs > 0 ? rng() % (cfg.jitterUs + 1) : 0);
+            // held back long enough for the datagrams after it to overtake
+            if (chance(cfg.reorder)) delay += cfg.latencyUs + cfg.jitterUs + 1;
+            if (current == N-1 || it->second == N-1) delay += cfg.slowUs;
+            schedule(leave + delay, SIM_TO_SERVER, it->second, forwAddresses[current], bytes);
+        } else if ((it = clientIndex.find(to)) != clientIndex.end()) {
+            schedule(leave + SIM_CLIENT_US, SIM_TO_CLIENT, it->second, forwAddresses[current], bytes);
+        }
+    }
+    return count;
+}
+
+static int simRecv(int fd, struct mmsghdr *msgs, unsigned int count, int flags) {
+    deque<pair<address,string> > &inbox = servers[current]->inbox;
+    if (inbox.empty()) {
+        errno = EAGAIN;
+        return -1;
+    }
+    unsigned int n = 0;
+    for (; n < count && !inbox.empty(); n++) {
+        struct msghdr &hdr = msgs[n].msg_hdr;
+        string &bytes = inbox.front().second;
+        size_t done = 0;
+        for (int j = 0; j < hdr.msg_iovlen && done < bytes.size(); j++) {
+            size_t part = min(bytes.size() - done, hdr.msg_iov[j].iov_len);
+            memcpy(hdr.msg_iov[j].iov_base, bytes.data() + done, part);
+            done += part;
+        }
+        *(struct sockaddr_in*) hdr.msg_name = toSockaddr(inbox.front().first);
+        msgs[n].msg_len = done;
+        inbox.pop_front();
+    }
+    return n;
+}
+
+static transport simTransport = { simSend, simRecv };
+
+static void serverMain(int id) {
+    sockfd = -1; // the transport knows which server is sending
+    ingest_init(simSlab, 1);
+    coalesce_init(NULL, forwAddresses.size());
+    frag_init(reassembly, FRAG_POOL_SLOTS);
+    for (int i = 0; i < forwAddresses.size(); i++) {
+        indexEntry *e = index_insert(endpoints, forwAddresses[i]);
+        e->kind = INDEX_PEER;
+        e->peer = i;
+    }
+    // nothing is watched, so the send queues' event_mod calls do nothing;
+    // the scheduler tells the server when its socket is writable
+    eventLoop loop = eventLoop();
+    sendq_init(loop, sockfd);
+    simServer &s = *servers[id];
+    s.mt = &metrics_local();
+    unique_lock<mutex> lock(simLock);
+    while (true) {
+        while (!s.busy && !stopping) s.wake.wait(lock);
+        if (!s.busy) break;
+        if (s.tick) {
+            frag_expire(reassembly);
+            interest_tick();
+        }
+        if (s.writable) sendq_drain();
+        int count = s.flush || s.tick || s.writable ? 0 : ingest_recv(sockfd, simSlab, MSG_DONTWAIT);
+        for (int i = 0; i < count; i++) {
+            handlePacket(ingest_src(simSlab, i), ingest_take(simSlab, i));
+        }
+        // a delay of 0 flushes at the end of every round of the event loop
+        if (s.flush || coalesce_delayUs == 0) coalesce_flushAll();
+        s.bundled = coalesce_pending();
+        s.waiting = sendq_busy();
+        s.busy = false;
+        simDone.notify_one();
+    }
+}
+
+// hand one datagram (or a flush) to a server and wait until it is handled
+static void dispatch(unique_lock<mutex> &lock, simEvent const &e) {
+    simServer &s = *servers[e.target];
+    current = e.target;
+    nn = e.target + 1;
+    selfAddr = forwAddresses[e.target];
+    peerDests = s.peers;
+    s.flush = e.kind == SIM_FLUSH;
+    s.tick = e.kind == SIM_TICK;
+    s.writable = e.kind == SIM_WRITABLE;
+    if (s.flush) s.flushDue = false;
+    if (s.writable) s.writableDue = false;
+    if (e.kind == SIM_TO_SERVER) s.inbox.push_back(make_pair(e.src, e.bytes));
+    s.busy = true;
+    s.wake.notify_one();
+    while (s.busy) simDone.wait(lock);
+    if (s.bundled && !s.flushDue) {
+        s.flushDue = true;
+        schedule(now + coalesce_delayUs, SIM_FLUSH, e.target, e.src, "");
+    }
+    if (s.waiting && !s.writableDue) {
+        // as the kernel does, writable once half the buffer is free
+        uint64_t half = (uint64_t) (cfg.sockBuf / 2) * cfg.wireUs;
+        s.writableDue = true;
+        schedule(max(now + 1, s.linkFree > half ? s.linkFree - half : 0), SIM_WRITABLE, e.target, e.src, "");
+    }
+}
+
+// "<nick> S <sender> <seq> <sent us>"
+static void onDelivery(simClient &c, string const &bytes, uint64_t at) {
+    int sender, seq;
+    uint64_t sent;
+    // memberships are only checked with churn, without it a gap is a loss
+    if (cfg.churn > 0 && bytes.compare(0, 28, "+OK You are now in chat room") == 0) check_joined(c);
+    if (!check_parse(bytes.data(), bytes.size(), 'S', sender, seq, sent)) return;
+    latencies.push_back(at - sent);
+    delivered++;
+    if (!check_delivered(c, sender, seq)) fifoViolations++;
+}
+
+static uint64_t percentile(double q) {
+    if (latencies.empty()) return 0;
+    return latencies[(size_t) (q * (latencies.size() - 1))];
+}
+
+static void run(const char *mode, int nservers, long rate, unsigned seed) {
+    N = nservers;
+    rng.seed(seed);
+    now = nextSeq = ticksEnd = 0;
+    peerDatagrams = dropped = delivered = fifoViolations = 0;
+    serverOut.assign(nservers, 0);
+    latencies.clear();
+    forwAddresses.clear();
+    serverIndex.clear();
+    clientIndex.clear();
+    for (int i = 0; i < N; i++) {
+        address a = { htonl(SIM_PEER_NET + i + 1), htons(5000) };
+        forwAddresses.push_back(a);
+        serverIndex[a] = i;
+    }
+    metrics_init(N);
+    stopping = false;
+    for (int i = 0; i < N; i++) {
+        simServer *s = new simServer();
+        s->busy = s->flush = s->tick = s->bundled = s->flushDue = false;
+        s->writable = s->waiting = s->writableDue = false;
+        s->linkFree = 0;
+        vector<address> peers;
+        for (int j = 0; j < N; j++) {
+            if (j != i) peers.push_back(forwAddresses[j]);
+        }
+        fanout_buildDests(peers, s->peers);
+        servers.push_back(s);
+    }
+    for (int i = 0; i < N; i++) servers[i]->worker = thread(serverMain, i);
+
+    // every client joins room i % rooms + 1, spread over the servers
+    users.assign(cfg.clients, simClient());
+    vector<long> roomSize(cfg.rooms + 1, 0);
+    for (int i = 0; i < cfg.clients; i++) {
+        simClient &c = users[i];
+        c.addr.addr = htonl(SIM_CLIENT_NET + i + 1);
+        c.addr.port = htons(6000);
+        c.server = (i / cfg.rooms) % N;
+        c.room = i % cfg.rooms + 1;
+        c.seq = 0;
+        clientIndex[c.addr] = i;
+        roomSize[c.room]++;
+        schedule(SIM_CLIENT_US, SIM_TO_SERVER, c.server, c.addr, "/join " + to_string(c.room));
+    }
+    // ticks spread over the first second, like servers started one by one
+    for (int i = 0; i < N; i++) {
+        schedule((uint64_t) SIM_TICK_US * (i + 1) / N, SIM_TICK, i, forwAddresses[i], "");
+    }
+    // part/join cycles spread over the run, a client is away from
+    // (part - SIM_CLIENT_US) to (join + SIM_CLIENT_US) and sends nothing then
+    vector<vector<pair<uint64_t,uint64_t> > > away(cfg.clients);
+    for (int j = 1; j <= cfg.churn; j++) {
+        uint64_t at = SIM_JOIN_US + (uint64_t) j * cfg.msgs * 1000000 / rate / (cfg.churn + 1);
+        int i = rng() % cfg.clients;
+        if (!away[i].empty() && away[i].back().second >= at) continue;
+        away[i].push_back(make_pair(at - SIM_CLIENT_US, at + SIM_AWAY_US + SIM_CLIENT_US));
+        simClient &c = users[i];
+        schedule(at, SIM_TO_SERVER, c.server, c.addr, "/part");
+        schedule(at + SIM_AWAY_US, SIM_TO_SERVER, c.server, c.addr, "/join " + to_string(c.room));
+    }
+    // paced messages, round robin over the clients
+    long sentLines = 0, expected = 0;
+    char line[128];
+    for (int k = 0; k < cfg.msgs; k++) {
+        simClient &c = users[k % cfg.clients];
+        uint64_t sent = SIM_JOIN_US + (uint64_t) k * 1000000 / rate;
+        ticksEnd = sent + SIM_TICK_US;
+        vector<pair<uint64_t,uint64_t> > const &gone = away[k % cfg.clients];
+        bool isAway = false;
+        for (int g = 0; g < gone.size(); g++) {
+            if (sent + SIM_CLIENT_US >= gone[g].first && sent + SIM_CLIENT_US <= gone[g].second) isAway = true;
+        }
+        if (isAway) continue;
+        snprintf(line, sizeof(line), "S %d %d %llu", k % cfg.clients, ++c.seq,
+                 (unsigned long long) sent);
+        schedule(sent + SIM_CLIENT_US, SIM_TO_SERVER, c.server, c.addr, line);
+        sentLines++;
+        expected += roomSize[c.room];
+    }
+
+    unique_lock<mutex> lock(simLock);
+    while (!events.empty()) {
+        simEvent *e = events.top();
+        events.pop();
+        now = e->at;
+        if (e->kind == SIM_TO_CLIENT) onDelivery(users[e->target], e->bytes, e->at);
+        else dispatch(lock, *e);
+        if (e->kind == SIM_TICK && now + SIM_TICK_US <= ticksEnd) {
+            schedule(now + SIM_TICK_US, SIM_TICK, e->target, e->src, "");
+        }
+        delete e;
+    }
+    stopping = true;
+    for (int i = 0; i < N; i++) servers[i]->wake.notify_one();
+    lock.unlock();
+    long queued = 0, queueDropped = 0, queueMax = 0, held = 0;
+    for (int i = 0; i < N; i++) {
+        servers[i]->worker.join();
+        metrics &mt = *servers[i]->mt;
+        queued += mt.sendQueued.load(memory_order_relaxed);
+        queueDropped += mt.sendDropped.load(memory_order_relaxed);
+        queueMax = max(queueMax, mt.sendQueueMax.load(memory_order_relaxed));
+        held += mt.fifoHeld.load(memory_order_relaxed);
+        delete servers[i];
+    }
+    servers.clear();
+
+    sort(latencies.begin(), latencies.end());
+    bool total = strcmp(mode, "total") == 0 || strcmp(mode, "sequencer") == 0;
+    vector<deliveryLog*> logs;
+    for (int i = 0; i < users.size(); i++) logs.push_back(&users[i]);
+    long fifoSeen = strcmp(mode, "unordered") == 0 ? 0 : fifoViolations;
+    long totalSeen = total ? check_totalViolations(logs, cfg.rooms) : 0;
+    if (fifoSeen > 0 || totalSeen > 0) violated = true;
+    // nothing lost, so every gap should have filled
+    if (held > 0 && cfg.drop == 0 && queueDropped == 0) violated = true;
+    printf("%s %d %d %d %ld %ld %ld %ld %ld %ld %ld %.2f %llu %llu %llu %ld %ld %ld %ld %ld %ld\n", mode, N,
+           cfg.clients, cfg.rooms, rate, sentLines, expected, delivered, peerDatagrams,
+           *max_element(serverOut.begin(), serverOut.end()), dropped,
+           delivered > 0 ? (double) peerDatagrams / delivered : 0,
+           (unsigned long long) percentile(0.50), (unsigned long long) percentile(0.99),
+           (unsigned long long) percentile(1.0),
+           fifoSeen, totalSeen, queued, queueDropped, queueMax, held);
+    fflush(stdout);
+}
+
+static vector<string> splitList(const char *arg) {
+    vector<string> out;
+    stringstream words(arg);
+    string word;
+    while (getline(words, word, ',')) {
+        if (!word.empty()) out.push_back(word);
+    }
+    return out;
+}
+
+static int modeOf(string const &mode) {
+    if (mode == "unordered") return 0;
+    if (mode == "fifo") return 1;
+    if (mode == "total") return 2;
+    if (mode == "sequencer") return 3;
+    throwMyError("Not a valid ordering mode");
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    vector<string> modes = splitList("unordered,fifo,total,sequencer");
+    vector<string> sizes = splitList("3");
+    vector<string> rates = splitList("1000");
+    unsigned seed = 1;
+    cfg.clients = 30;
+    cfg.rooms = 3;
+    cfg.msgs = 1000;
+    cfg.churn = 0;
+    cfg.latencyUs = 500;
+    cfg.jitterUs = 0;
+    cfg.slowUs = 0;
+    cfg.drop = 0;
+    cfg.interestDrop = 0;
+    cfg.reorder = 0;
+    cfg.sockBuf = 0;
+    cfg.wireUs = SIM_WIRE_US;
+    int c;
+    while ((c = getopt(argc, argv, "o:n:c:r:m:R:l:j:p:P:q:S:W:B:w:k:K:T:IGC:E:D:Q:s:v")) != -1) {
+        switch (c) {
+        case 'o': modes = splitList(optarg); break;
+        case 'n': sizes = splitList(optarg); break;
+        case 'c': cfg.clients = atoi(optarg); break;
+        case 'r': cfg.rooms = atoi(optarg); break;
+        case 'm': cfg.msgs = atoi(optarg); break;
+        case 'R': rates = splitList(optarg); break;
+        case 'l': cfg.latencyUs = atoi(optarg); break;
+        case 'j': cfg.jitterUs = atoi(optarg); break;
+        case 'p': cfg.drop = atof(optarg); break;
+        case 'P': cfg.interestDrop = atof(optarg); break;
+        case 'q': cfg.reorder = atof(optarg); break;
+        case 'S': cfg.slowUs = atoi(optarg); break;
+        case 'W': total_window = atoi(optarg); break;
+        case 'B': total_batch = atoi(optarg); break;
+        case 'w':
+            if (strcmp(optarg,"binary") == 0) wire_text = 0;
+            else if (strcmp(optarg,"text") == 0) wire_text = 1;
+            else throwMyError("Not a valid wire format");
+            break;
+        case 'k':
+            coalesce_delayUs = strcmp(optarg, "off") == 0 ? COALESCE_OFF : atoi(optarg);
+            break;
+        case 'K': coalesce_cap = atoi(optarg); break;
+        case 'T': relay_degree = atoi(optarg); break;
+        case 'I': interest_routing = 1; break;
+        case 'G': group_routing = 1; break;
+        case 'C': cfg.churn = atoi(optarg); break;
+        case 'E': cfg.sockBuf = atoi(optarg); break;
+        case 'D': cfg.wireUs = atoi(optarg); break;
+        case 'Q': sendq_limit = atoi(optarg); break;
+        case 's': seed = atoi(optarg); break;
+        case 'v': debug_mode = 1; break;
+        default:
+            fprintf(stderr, "usage: %s [-o modes] [-n servers] [-c clients] [-r rooms] [-m msgs] "
+                    "[-R msgs/s] [-l latency_us] [-j jitter_us] [-p drop%%] [-P interest drop%%] [-q reorder%%] [-S slow_us] "
+                    "[-W window] [-B batch] [-w binary|text] [-k off|delay_us] [-K bundle bytes] "
+                    "[-T relay degree] [-I] [-G] [-C cycles] [-E socket datagrams] [-D us per datagram] "
+                    "[-Q queue limit] [-s seed] [-v]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (cfg.clients < 1 || cfg.rooms < 1 || cfg.msgs < 0 || cfg.churn < 0 || cfg.latencyUs < 0 ||
+        cfg.jitterUs < 0 || cfg.slowUs < 0 || cfg.sockBuf < 0 || cfg.wireUs < 1 || sendq_limit < 1 || total_window < 1 || total_batch < 1 ||
+        relay_degree < 0 || coalesce_delayUs < COALESCE_OFF || coalesce_cap < WIRE_HEADER + 64 || coalesce_cap > MSG_BUFSIZE) {
+        throwMyError("Bad parameters");
+    }
+    cfg.rooms = min(cfg.rooms, cfg.clients);
+    if (wire_text) total_window = total_batch = 1; // text messages carry no ids
+
+    transport_set(&simTransport);
+    shard_init(1, runHandoff);
+    printf("mode servers clients rooms rate sent expected delivered peer_datagrams busiest_out dropped "
+           "datagrams_per_delivery p50_us p99_us max_us fifo_violations total_violations queued "
+           "queue_dropped queue_max fifo_held\n");
+    for (int m = 0; m < modes.size(); m++) {
+        order_mode = modeOf(modes[m]);
+        for (int n = 0; n < sizes.size(); n++) {
+            for (int r = 0; r < rates.size(); r++) {
+                int nservers = atoi(sizes[n].c_str());
+                long rate = atol(rates[r].c_str());
+                if (nservers < 1 || rate < 1) throwMyError("Bad parameters");
+                run(modes[m].c_str(), nservers, rate, seed);
+            }
+        }
+    }
+    return violated ? 1 : 0;
+}
@@ -0,0 +1,57 @@
+#ifndef __cs_bench_h_
+#define __cs_bench_h_
+#include "cs_common.h"
+#include <chrono>
+
+// what the micro-benchmarks share (holdback_bench, protocol_bench)
+
+// a message to hold back, every field set
+inline totalMsg bench_totalMsg(int P, address node, msgRef const &line, uint64_t queuedUs) {
+    totalMsg m;
+    m.timestamp = P;
+    m.node = node;
+    m.msg = line;
+    m.deliverable = false;
+    m.msgId = 0;
+    m.batched = false;
+    m.queuedUs = queuedUs;
+    m.join = false;
+    return m;
+}
+
+// a holdback queue at a steady depth: fills it to depth, then each op holds
+// two messages, finalizes a random pending one behind everything else and
+// the oldest one in place, and delivers what is at the front. the same
+// depth gives the same work on every queue. L has hold(P),
+// finalize(oldP, T) and deliver(); returns ns per op
+template <class L>
+double bench_holdbackLoad(L &load, int depth, int ops) {
+    srand(depth);
+    vector<int> pending; // proposals in hold order, -1 once finalized
+    int P = 0, head = 0;
+    for (int i = 0; i < depth; i++) {
+        load.hold(++P);
+        pending.push_back(P);
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < ops; i++) {
+        for (int j = 0; j < 2; j++) {
+            load.hold(++P);
+            pending.push_back(P);
+        }
+        int r;
+        do {
+            r = head + 1 + rand() % (pending.size() - head - 1);
+        } while (pending[r] < 0);
+        load.finalize(pending[r], ++P);
+        pending[r] = -1;
+        load.finalize(pending[head], pending[head]);
+        pending[head] = -1;
+        while (head < pending.size() && pending[head] < 0) head++; // at depth 0 all are done
+        load.deliver();
+    }
+    chrono::nanoseconds took = chrono::steady_clock::now() - start;
+    return (double) took.count() / ops;
+}
+
+#endif
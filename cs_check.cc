@@ -0,0 +1,78 @@
+#include "cs_check.h"
+
+// "<nick> <tag> <sender> <seq> <sent>", false for any other line
+bool check_parse(const char *buf, int len, char tag, int &sender, int &seq, uint64_t &sent) {
+    char prefix[] = { '>', ' ', tag, ' ' };
+    const char *p = (const char*) memmem(buf, len, prefix, sizeof(prefix));
+    if (p == NULL) return false;
+    unsigned long long at;
+    if (sscanf(p + sizeof(prefix), "%d %d %llu", &sender, &seq, &at) != 3) return false;
+    sent = at;
+    return true;
+}
+
+// logs a delivery, false if it breaks the sender's FIFO order; for logs
+// that mark their joins also if it skips one in the middle of a membership
+bool check_delivered(deliveryLog &log, int sender, int seq) {
+    int &last = log.lastSeen[sender];
+    bool inOrder = seq > last;
+    if (inOrder && seq > last + 1 && last > 0 && !log.joins.empty() &&
+        log.lastAt[sender] >= log.joins.back()) inOrder = false;
+    last = seq;
+    log.lastAt[sender] = log.order.size();
+    log.order.push_back(((uint64_t) sender << 32) | (uint32_t) seq);
+    return inOrder;
+}
+
+// the client is in the room again, what it gets from now on is a new
+// membership
+void check_joined(deliveryLog &log) {
+    log.joins.push_back(log.order.size());
+}
+
+// messages a member missed between the first and last it delivered in one
+// membership, given their positions in the agreed order
+static long holes(vector<int> &at) {
+    if (at.empty()) return 0;
+    long missed = *max_element(at.begin(), at.end()) - *min_element(at.begin(), at.end()) + 1 - at.size();
+    at.clear();
+    return missed;
+}
+
+// members of a room must agree on the order of what they all delivered:
+// counts the messages that come before one they should follow and, for
+// logs that mark their joins, the ones a member missed in the middle of a
+// membership. the member that delivered the most gives the order
+long check_totalViolations(vector<deliveryLog*> const &logs, int rooms) {
+    long bad = 0;
+    for (int r = 1; r <= rooms; r++) {
+        deliveryLog *ref = NULL;
+        for (int i = 0; i < logs.size(); i++) {
+            if (logs[i]->room != r) continue;
+            if (ref == NULL || logs[i]->order.size() > ref->order.size()) ref = logs[i];
+        }
+        if (ref == NULL) continue;
+        unordered_map<uint64_t,int> pos;
+        for (int k = 0; k < ref->order.size(); k++) pos[ref->order[k]] = k;
+        vector<int> at;
+        for (int i = 0; i < logs.size(); i++) {
+            deliveryLog &c = *logs[i];
+            if (c.room != r || &c == ref) continue;
+            int last = -1;
+            size_t next = 0; // next join
+            for (size_t k = 0; k < c.order.size(); k++) {
+                if (next < c.joins.size() && c.joins[next] <= k) {
+                    while (next < c.joins.size() && c.joins[next] <= k) next++;
+                    bad += holes(at);
+                }
+                unordered_map<uint64_t,int>::iterator it = pos.find(c.order[k]);
+                if (it == pos.end()) continue;
+                if (it->second < last) bad++;
+                last = max(last, it->second);
+                if (!c.joins.empty()) at.push_back(it->second);
+            }
+            bad += holes(at);
+        }
+    }
+    return bad;
+}
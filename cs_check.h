@@ -0,0 +1,20 @@
+#ifndef __cs_check_h_
+#define __cs_check_h_
+#include "cs_common.h"
+
+// delivery checks shared by chatbench and chatsim. their clients send
+// "<tag> <sender> <seq> <sent time>" lines and keep a log of what comes back
+struct deliveryLog {
+    int room;
+    unordered_map<int,int> lastSeen; // sender -> last seq delivered, fifo check
+    vector<uint64_t> order; // (sender << 32 | seq) in delivery order, total check
+    vector<size_t> joins; // where in order each membership of the room starts
+    unordered_map<int,size_t> lastAt; // sender -> where in order its last delivery is
+};
+
+bool check_parse(const char *buf, int len, char tag, int &sender, int &seq, uint64_t &sent);
+bool check_delivered(deliveryLog &log, int sender, int seq);
+void check_joined(deliveryLog &log);
+long check_totalViolations(vector<deliveryLog*> const &logs, int rooms);
+
+#endif
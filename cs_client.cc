@@ -1,47 +1,82 @@
 #include "cs_client.h"
+#include "cs_shard.h"
+#include "cs_index.h"
+#include "cs_metrics.h"
+#include "cs_idle.h"
 
-void client_quit(address client) {
-    int currRoomId = clients[client].roomId;
-    string clientId = clients[client].id;
-    clients.erase(client);
-    if (currRoomId > 0) {
-        vector<address> &room = chatrooms[currRoomId];
-        vector<address>::iterator it = find(room.begin(), room.end(), client);
-        room.erase(it);
+int client_rate = 0;
+int client_burst = 0;
+
+// token bucket: refills at client_rate lines per second up to the burst,
+// a line takes one token. lines without one are dropped (shed) before they
+// cost any ordering or fan-out work
+bool client_allow(clientInfo &client) {
+    if (client_rate <= 0) return true;
+    uint64_t now = metrics_nowUs();
+    double cap = client_burst > 0 ? client_burst : client_rate;
+    if (client.refillUs == 0) client.tokens = cap;
+    else client.tokens = min(cap, client.tokens + (now - client.refillUs) * client_rate / 1e6);
+    client.refillUs = now;
+    if (client.tokens >= 1) {
+        client.tokens -= 1;
+        client.throttled = false;
+        return true;
     }
+    metric_add(metrics_local().clientShed);
+    if (!client.throttled) sendResponse(client.addr, "-ERR Too many messages, lines are dropped");
+    client.throttled = true;
+    return false;
+}
+
+void client_quit(clientInfo &client) {
+    int currRoomId = client.roomId;
+    string clientId = client.id;
+    address addr = client.addr;
+    idle_forget(client);
+    index_erase(endpoints, addr);
+    clients.erase(addr);
+    metric_add(metrics_local().clients, -1);
+    if (currRoomId > 0) client_leaveRoom(addr, currRoomId);
     if (debug_mode) debug_msg("Client quitted", clientId.c_str());
 } 
 
-void client_part(address client) {
-    int currRoomId = clients[client].roomId; 
+void client_part(clientInfo &client) {
+    int currRoomId = client.roomId; 
     if (currRoomId == 0) {
-        sendResponse(client, "-ERR you are not in a room yet");
+        sendResponse(client.addr, "-ERR you are not in a room yet");
         return;
     }
-    vector<address> &room = chatrooms[currRoomId];
-    vector<address>::iterator it = find(room.begin(), room.end(), client);
-    room.erase(it);
-    clients[client].roomId = 0;
-    sendResponse(client, "+OK You have left chat room #", currRoomId);
+    client_leaveRoom(client.addr, currRoomId);
+    client.roomId = 0;
+    sendResponse(client.addr, "+OK You have left chat room #", currRoomId);
     if (debug_mode) debug_msg("Client left chat room #", currRoomId);
 }
 
-void client_nick(address client, string const &name) {
-    clients[client].nickname = name;
-    sendResponse(client, "+OK Your new nickname is", name.c_str());
+void client_nick(clientInfo &client, string const &name) {
+    client.nickname = name;
+    sendResponse(client.addr, "+OK Your new nickname is", name.c_str());
     if (debug_mode) debug_msg("Client changed nickname to", name.c_str());
 }
 
-void client_join(address client, int newRoomId) {
-    int currRoomId = clients[client].roomId; 
+void client_join(clientInfo &client, int newRoomId) {
+    int currRoomId = client.roomId; 
     if (currRoomId != 0) {
-        sendResponse(client, "-ERR you are already in room #", currRoomId);
+        sendResponse(client.addr, "-ERR you are already in room #", currRoomId);
         return;
     }
-    clients[client].roomId = newRoomId;
-    chatrooms[newRoomId].push_back(client);
-    sendResponse(client, "+OK You are now in chat room #", newRoomId);
+    client.roomId = newRoomId;
+    client_enterRoom(client.addr, newRoomId);
+    sendResponse(client.addr, "+OK You are now in chat room #", newRoomId);
     if (debug_mode) debug_msg("Client joined chat room #", newRoomId);
 }
 
+// membership lives with the worker owning the room
+void client_enterRoom(address client, int roomId) {
+    handoffItem item = { HANDOFF_JOIN, roomId, client, 0 };
+    shard_run(item);
+}
 
+void client_leaveRoom(address client, int roomId) {
+    handoffItem item = { HANDOFF_LEAVE, roomId, client, 0 };
+    shard_run(item);
+}
@@ -2,9 +2,15 @@
 #define __cs_client_h_
 #include "cs_common.h"
 
-void client_nick(address client, string const &name);
-void client_part(address client);
-void client_quit(address client);
-void client_join(address client, int newRoomId);
+extern int client_rate; // chat lines per second and client, 0 unlimited
+extern int client_burst; // lines a quiet client may send at once, 0 one second's worth
+
+bool client_allow(clientInfo &client);
+void client_nick(clientInfo &client, string const &name);
+void client_part(clientInfo &client);
+void client_quit(clientInfo &client);
+void client_join(clientInfo &client, int newRoomId);
+void client_enterRoom(address client, int roomId);
+void client_leaveRoom(address client, int roomId);
 
 #endif
@@ -0,0 +1,79 @@
+#include "cs_coalesce.h"
+#include "cs_wire.h"
+#include "cs_fanout.h"
+#include "cs_metrics.h"
+
+int coalesce_delayUs = COALESCE_OFF;
+int coalesce_cap = MSG_BUFSIZE;
+
+extern vector<address> forwAddresses;
+
+static thread_local vector<coalesceBuf> bundles; // by server index
+static thread_local int pending = 0; // bundles holding messages
+static thread_local int timerFd = -1;
+
+static void onFlushTimer(int fd, int events, void *arg) {
+    coalesce_flushAll();
+}
+
+static void afterRound() {
+    coalesce_flushAll();
+}
+
+// per worker. without a loop the caller flushes (see chatsim.cc)
+void coalesce_init(eventLoop *loop, int peers) {
+    bundles.assign(peers, coalesceBuf());
+    for (int i = 0; i < peers; i++) {
+        bundles[i].bytes.resize(coalesce_cap);
+        bundles[i].used = bundles[i].count = 0;
+    }
+    pending = 0;
+    if (loop == NULL || coalesce_delayUs == COALESCE_OFF || wire_text) return;
+    if (coalesce_delayUs > 0) timerFd = event_addTimer(*loop, 0, onFlushTimer, NULL);
+    else event_setAfterPoll(*loop, afterRound);
+}
+
+// true if an encoded message of len bytes goes into a bundle
+bool coalesce_fits(int len) {
+    return coalesce_delayUs != COALESCE_OFF && !wire_text && WIRE_HEADER + 2 + len <= coalesce_cap;
+}
+
+// queue one encoded message (coalesce_fits) for a server
+void coalesce_add(int peer, const char *msg, int len) {
+    coalesceBuf &b = bundles[peer];
+    if (WIRE_HEADER + b.used + 2 + len > coalesce_cap) coalesce_flush(peer);
+    if (b.count == 0 && pending++ == 0 && timerFd >= 0) event_setTimer(timerFd, coalesce_delayUs);
+    b.used += wire_batchAppend(&b.bytes[WIRE_HEADER + b.used], msg, len);
+    b.count++;
+    metric_add(metrics_local().coalesced);
+}
+
+// send what is waiting for a server; a single message goes out as it is
+void coalesce_flush(int peer) {
+    coalesceBuf &b = bundles[peer];
+    if (b.count == 0) return;
+    const char *out = &b.bytes[WIRE_HEADER + 2];
+    int len = b.used - 2;
+    if (b.count > 1) {
+        wireMsg m = wire_make(WIRE_BUNDLE, 0, NULL, b.used);
+        wire_header(m, &b.bytes[0]);
+        out = &b.bytes[0];
+        len = WIRE_HEADER + b.used;
+    }
+    struct sockaddr_in dest = toSockaddr(forwAddresses[peer]);
+    fanout_send(sockfd, &dest, 1, out, len);
+    metrics &mt = metrics_local();
+    metric_add(mt.peerOut[peer]);
+    metric_add(mt.bundles);
+    if (debug_mode && b.count > 1) debug_msg("Sent bundle of server messages:", b.count);
+    b.used = b.count = 0;
+    if (--pending == 0 && timerFd >= 0) event_setTimer(timerFd, 0);
+}
+
+void coalesce_flushAll() {
+    for (int i = 0; i < bundles.size() && pending > 0; i++) coalesce_flush(i);
+}
+
+bool coalesce_pending() {
+    return pending > 0;
+}
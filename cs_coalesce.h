@@ -0,0 +1,29 @@
+#ifndef __cs_coalesce_h_
+#define __cs_coalesce_h_
+#include "cs_common.h"
+#include "cs_event.h"
+
+// server messages bound for the same peer are packed into one WIRE_BUNDLE
+// datagram (binary wire format only). a peer's bundle goes out when the
+// next message would not fit coalesce_cap bytes, coalesce_delayUs after
+// the first message went into an empty coalescer, or at the end of every
+// event loop round when the delay is 0
+#define COALESCE_OFF -1
+
+struct coalesceBuf {
+    vector<char> bytes; // bundle header, then (len(2), encoded message)*
+    int used; // bytes after the header
+    int count; // messages in the bundle
+};
+
+extern int coalesce_delayUs; // COALESCE_OFF, 0, or the longest a message waits
+extern int coalesce_cap; // largest bundle datagram
+
+void coalesce_init(eventLoop *loop, int peers);
+bool coalesce_fits(int len);
+void coalesce_add(int peer, const char *msg, int len);
+void coalesce_flush(int peer);
+void coalesce_flushAll();
+bool coalesce_pending();
+
+#endif
@@ -1,4 +1,6 @@
 #include "cs_common.h"
+#include "cs_log.h"
+#include "cs_fanout.h"
 
 bool operator < (const address &a, const address &b) {
     return tie(a.addr, a.port) < tie(b.addr, b.port);
@@ -12,10 +14,6 @@ bool operator < (const totalMsg &a, const totalMsg &b) {
     return tie(a.timestamp, a.node) < tie(b.timestamp, b.node);
 }
 
-bool operator < (const fifoMsg &a, const fifoMsg &b) {
-    return a.id > b.id;
-}
-
 void populateServers(vector<address> &f, vector<address> &b, const char* filename) {
     ifstream infile(filename);
     string line;
@@ -43,54 +41,36 @@ void populateServers(vector<address> &f, vector<address> &b, const char* filenam
     }
 }
 
-// server sends response to client
+// server sends response to client; a failed send is counted, a full
+// socket queues it (cs_sendq.h)
 void sendResponse(struct address client, const char *msg, int val) {
-    struct sockaddr_in addr; bzero(&addr, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = client.addr;
-    addr.sin_port = client.port;
-    char buf[strlen(msg) + 3];
-    sprintf(buf, "%s%d", msg, val);
-    int status = sendto(sockfd, buf, strlen(buf), 0, 
-                    (struct sockaddr*) &addr, sizeof(addr));
-    if (status < 0) throwSysError("Error sending response to client");
+    char buf[strlen(msg) + 12]; // room for any int and the 0
+    snprintf(buf, sizeof(buf), "%s%d", msg, val);
+    sendResponse(client, buf);
 }
 
 void sendResponse(struct address client, const char *msg, const char *val) {
-    struct sockaddr_in addr; bzero(&addr, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = client.addr;
-    addr.sin_port = client.port;
-    char buf[strlen(msg) + strlen(val)];
-    sprintf(buf, "%s %s", msg, val);
-    int status = sendto(sockfd, buf, strlen(buf), 0, 
-                    (struct sockaddr*) &addr, sizeof(addr));
-    if (status < 0) throwSysError("Error sending response to client");
+    char buf[strlen(msg) + strlen(val) + 2];
+    snprintf(buf, sizeof(buf), "%s %s", msg, val);
+    sendResponse(client, buf);
 }
 
 void sendResponse(struct address client, const char *msg) {
-    struct sockaddr_in addr; bzero(&addr, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = client.addr;
-    addr.sin_port = client.port;
-    int status = sendto(sockfd, msg, strlen(msg), 0, 
-                    (struct sockaddr*) &addr, sizeof(addr));
-    if (status < 0) throwSysError("Error sending response to client");
+    struct sockaddr_in dest = toSockaddr(client);
+    fanout_send(sockfd, &dest, 1, msg, strlen(msg));
 }
 
+// msg has to be a string literal, the log keeps its address
 void debug_msg(const char* msg) {
-    string time = getFormattedTime();
-    printf("%s S%02d %s\n", time.c_str(), nn, msg);
+    log_record(nn, msg, LOG_PLAIN, 0, NULL);
 }
 
 void debug_msg(const char* msg, int val) {
-    string time = getFormattedTime();
-    printf("%s S%02d %s %d\n", time.c_str(), nn, msg, val);
+    log_record(nn, msg, LOG_INT, val, NULL);
 }
 
 void debug_msg(const char* msg, const char *val) {
-    string time = getFormattedTime();
-    printf("%s S%02d %s %s\n", time.c_str(), nn, msg, val);
+    log_record(nn, msg, LOG_STR, 0, val);
 }
 
 void throwSysError(const char* msg) { perror(msg); exit(1); }
@@ -100,17 +80,32 @@ string getFormattedTime() {
     char buffer1[80], buffer2[80];
     struct timeval rawtime;
     gettimeofday(&rawtime, NULL);
-    struct tm *timeinfo = localtime(&rawtime.tv_sec);
-    strftime(buffer1,80,"%R:%S",timeinfo);
+    struct tm timeinfo;
+    localtime_r(&rawtime.tv_sec, &timeinfo);
+    strftime(buffer1,80,"%R:%S",&timeinfo);
     snprintf(buffer2,80, "%s.%06ld", buffer1, rawtime.tv_usec);
     string out(buffer2);
     return out;
 }
 
 string formatAddress(address input) {
-    in_addr wrapper;
-    wrapper.s_addr = input.addr;
-    string out = inet_ntoa(wrapper) + string(":") + to_string(ntohs(input.port));
+    char buf[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &input.addr, buf, sizeof(buf));
+    string out = buf + string(":") + to_string(ntohs(input.port));
+    return out;
+}
+
+struct sockaddr_in toSockaddr(address input) {
+    struct sockaddr_in out;
+    bzero(&out, sizeof(out));
+    out.sin_family = AF_INET;
+    out.sin_port = input.port;
+    out.sin_addr.s_addr = input.addr;
+    return out;
+}
+
+address toAddress(struct sockaddr_in const &input) {
+    address out = { input.sin_addr.s_addr, input.sin_port };
     return out;
 }
 
@@ -122,15 +117,16 @@ void printServers(vector<address> &servers) {
 }
 
 // debugging helper method
-void printHoldbackQueue(vector<totalMsg> &queue) {
+void printHoldbackQueue(holdbackQueue &queue) {
     cout << "---- start -----" << endl;
     cout << "timestamp | node | deliverable" << endl;
-    for (int i = 0; i < queue.size(); i++) {
-        totalMsg &curr = queue[i];
+    set<holdbackKey>::iterator it;
+    for (it = queue.order.begin(); it != queue.order.end(); it++) {
+        totalMsg &curr = queue.entries[it->slot];
         cout << curr.timestamp << " | " 
             // << curr.node << " | "
             << "(" << curr.node.addr << "," << curr.node.port << ")" << " | "
-            << curr.deliverable << " | " << curr.msg << endl;
+            << curr.deliverable << " | " << msgref_str(curr.msg) << endl;
     }
     cout << "---- end -----" << endl << endl;
 }
@@ -138,9 +134,9 @@ void printHoldbackQueue(vector<totalMsg> &queue) {
 void printClientStats() {
     cout << "total # of clients = " << clients.size() << endl;
     cout << "Room | # Clients" << endl;
-    map<int,vector<address> >::iterator it;
+    map<int,chatroom>::iterator it;
     for (it = chatrooms.begin(); it != chatrooms.end(); it++) {
-        cout << it->first << " | " << it->second.size() << endl;
+        cout << it->first << " | " << it->second.members.size() << endl;
     }
 }
 
@@ -17,12 +17,18 @@
 #include <set>
 #include <queue>
 #include <map> 
+#include <unordered_map>
 #include <tuple>
 #include <assert.h>
+#include "cs_msgbuf.h"
+#include "cs_wheel.h"
 
 using namespace std;
 
 #define comma ","
+#define MSG_BUFSIZE 1472 // one ethernet frame, largest server-to-server datagram
+#define MSG_MAXSIZE 65507 // largest UDP datagram, client traffic may use all of it
+#define MSG_MAXLINE (MSG_MAXSIZE - 64) // longest chat line, leaves room for headers
 
 struct address {
     uint32_t addr;
@@ -30,57 +36,113 @@ struct address {
 };
 
 struct clientInfo {
+    address addr;
     string id; // address and port of client
     string nickname;
     int roomId;
-    int counts[10]; // count of messages sent so far
+    map<int,int> counts; // count of messages sent so far, per room
+    uint64_t lastSeen; // idle timer wheel tick of the last datagram, see cs_idle.h
+    double tokens; // chat lines the client may send right now (client_allow)
+    uint64_t refillUs; // tokens last topped up, 0 before the first line
+    bool throttled; // told about dropped lines, until one goes through again
+    wheelTimer idle;
 };
 
-struct fifoMsg {
-    int id;
-    string msg;
+struct chatroom {
+    vector<address> members; // dense, order is not kept on leave
+    vector<struct sockaddr_in> dests; // dests[i] is members[i], ready for sendmmsg
 };
 
-struct fifoQueue {
-    int lastMsgId;
-    priority_queue<fifoMsg> queue;
+// fifo ordering: one stream per (sender client, room)
+struct fifoKey {
+    uint64_t sender; // packed address, addr << 16 | port
+    int roomId;
+};
+
+struct fifoKeyHash {
+    size_t operator () (const fifoKey &k) const;
+};
+
+struct fifoStream {
+    int lastMsgId; // last message delivered
+    int buffered; // messages parked in slots
+    vector<msgRef> slots; // ring of FIFO_WINDOW, allocated on the first gap
+    vector<bool> present;
 };
 
 struct totalMsg {
     int timestamp;
     address node;
-    string msg;
+    msgRef msg;
     bool deliverable;
+    int msgId; // sender's id for the message, breaks timestamp ties
+    bool batched; // msg packs several chat lines, see wire_batchAppend
+    uint64_t queuedUs; // entered the holdback queue, for metrics
+    bool join; // our own group join, marks where delivery starts (cs_group.h)
+};
+
+// position of a held back message, ordered by (timestamp, node)
+struct holdbackKey {
+    int timestamp;
+    address node;
+    int msgId;
+    int slot; // index into holdbackQueue.entries
+};
+
+struct holdbackQueue {
+    vector<totalMsg> entries; // message storage, slots are reused
+    vector<int> freeSlots;
+    set<holdbackKey> order; // delivery order, front is the next to deliver
+    unordered_map<int,int> byProposal; // proposed timestamp -> slot, undeliverable only
+};
+
+// one message of the sender waiting for proposals
+struct total_round {
+    msgRef msg; // one chat line, or a batch of them
+    bool batched;
+    map<address, int> responses;
+    int need; // responses that finish the round, ours included
+    vector<int> peers; // servers asked, by index, when the room has a group
+    bool join; // our group join, see cs_group.h
+    int T; // highest proposal so far
+    uint64_t startUs; // initial message sent, for metrics
 };
 
 // data structure for the sender side
 struct total_s {
-    map<address, int> responses;
-    int T;
-    queue<string> msgQueue;
-    bool busy = false;
+    int nextId; // id of the last message sent out
+    map<int, total_round> inflight; // msg id -> round, at most total_window
+    queue<msgRef> msgQueue; // not sent out yet
 };
 
 // data structure for the recipient side
 struct total_r {
     int P; // highest proposed number
     int A; // highest agreed number seen so far
-    vector<totalMsg> queue;
+    holdbackQueue queue;
 };
 
 bool operator < (const address &a, const address &b);
 bool operator == (const address &a, const address &b);
 bool operator < (const totalMsg &a, const totalMsg &b);
-bool operator < (const fifoMsg &a, const fifoMsg &b);
+bool operator == (const fifoKey &a, const fifoKey &b);
+bool operator < (const holdbackKey &a, const holdbackKey &b);
+
+// sequencer ordering: receiving side of one room
+struct seq_r {
+    int next; // sequence number to deliver next, minus one
+    map<int, msgRef> gap; // arrived ahead of next
+};
 
 // GLOBAL VARIABLES
 extern int N; // total number of servers in the list of servers
 extern int nn; // index of this server in list of servers
-extern int sockfd;
+extern thread_local int sockfd;
 
 extern int debug_mode;
-extern map<address,clientInfo> clients; // client addresses to nicknames 
-extern map<int, vector<address> > chatrooms;
+extern thread_local map<address,clientInfo> clients; // client addresses to nicknames 
+extern thread_local struct addrIndex endpoints; // peers and clients by address
+extern thread_local map<int, chatroom> chatrooms;
 
 // METHODS 
 void populateServers(vector<address> &f, vector<address> &b, const char* filename);
@@ -94,7 +156,9 @@ void debug_msg(const char* msg, int val);
 void debug_msg(const char* msg, const char *val);
 string getFormattedTime();
 string formatAddress(address input);
+struct sockaddr_in toSockaddr(address input);
+address toAddress(struct sockaddr_in const &input);
 void printServers(set<address> &servers);
-void printHoldbackQueue(vector<totalMsg> &queue);
+void printHoldbackQueue(holdbackQueue &queue);
 void printClientStats();
 #endif
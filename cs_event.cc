@@ -0,0 +1,320 @@
+#include "cs_event.h"
+#include <errno.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#define EV_MAX_EVENTS 64
+#define URING_ENTRIES 256
+#define URING_TAG_IGNORE (~(uint64_t) 0) // completions nobody waits for
+
+static void dispatch(eventLoop &loop, int fd, uint32_t gen, int events);
+
+//===== io_uring backend =======
+// poll-only use of the ring: every watch has one IORING_OP_POLL_ADD armed,
+// which is re-armed after its handler ran (polls are one-shot)
+#ifdef HAVE_IO_URING
+struct uringState {
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    unsigned sqEntries;
+    unsigned tail; // local copy of the sq tail, published on submit
+    unsigned pending; // sqes queued but not yet submitted
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    struct __kernel_timespec ts; // must outlive the submit of a timeout sqe
+};
+
+static uint64_t uring_tag(int fd, uint32_t gen) {
+    return ((uint64_t) gen << 32) | (uint32_t) fd;
+}
+
+static int uring_enter(eventLoop &loop, unsigned toSubmit, unsigned minComplete) {
+    unsigned flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+    int status;
+    do {
+        status = syscall(__NR_io_uring_enter, loop.fd, toSubmit, minComplete,
+                         flags, NULL, 0);
+    } while (status < 0 && errno == EINTR && minComplete == 0);
+    return status;
+}
+
+static void uring_flush(eventLoop &loop, unsigned minComplete) {
+    uringState *r = loop.ring;
+    __atomic_store_n(r->sqTail, r->tail, __ATOMIC_RELEASE);
+    unsigned toSubmit = r->pending;
+    r->pending = 0;
+    if (uring_enter(loop, toSubmit, minComplete) < 0 && errno != EINTR && errno != ETIME) {
+        if (debug_mode) debug_msg("io_uring_enter failed");
+    }
+}
+
+static struct io_uring_sqe *uring_sqe(eventLoop &loop) {
+    uringState *r = loop.ring;
+    unsigned head = __atomic_load_n(r->sqHead, __ATOMIC_ACQUIRE);
+    if (r->tail - head >= r->sqEntries) {
+        uring_flush(loop, 0); // ring full, hand what we have to the kernel
+        head = __atomic_load_n(r->sqHead, __ATOMIC_ACQUIRE);
+    }
+    unsigned idx = r->tail & *r->sqMask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sqArray[idx] = idx;
+    r->tail++;
+    r->pending++;
+    return sqe;
+}
+
+static void uring_arm(eventLoop &loop, eventWatch &w) {
+    struct io_uring_sqe *sqe = uring_sqe(loop);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = w.fd;
+    unsigned mask = 0;
+    if (w.events & EV_READ) mask |= POLLIN;
+    if (w.events & EV_WRITE) mask |= POLLOUT;
+    sqe->poll_events = mask;
+    sqe->user_data = uring_tag(w.fd, w.gen);
+}
+
+static void uring_disarm(eventLoop &loop, eventWatch &w) {
+    struct io_uring_sqe *sqe = uring_sqe(loop);
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->addr = uring_tag(w.fd, w.gen);
+    sqe->user_data = URING_TAG_IGNORE;
+    w.gen++;
+}
+
+static bool uring_setup(eventLoop &loop) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (fd < 0) return false;
+
+    size_t sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cqSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) sqSize = cqSize = max(sqSize, cqSize);
+    char *sq = (char*) mmap(NULL, sqSize, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) { close(fd); return false; }
+    char *cq = sq;
+    if (!single) {
+        cq = (char*) mmap(NULL, cqSize, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED) { close(fd); return false; }
+    }
+    void *sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) { close(fd); return false; }
+
+    uringState *r = new uringState();
+    r->sqHead = (unsigned*) (sq + p.sq_off.head);
+    r->sqTail = (unsigned*) (sq + p.sq_off.tail);
+    r->sqMask = (unsigned*) (sq + p.sq_off.ring_mask);
+    r->sqArray = (unsigned*) (sq + p.sq_off.array);
+    r->cqHead = (unsigned*) (cq + p.cq_off.head);
+    r->cqTail = (unsigned*) (cq + p.cq_off.tail);
+    r->cqMask = (unsigned*) (cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+    r->sqes = (struct io_uring_sqe*) sqes;
+    r->sqEntries = p.sq_entries;
+    r->tail = *r->sqTail;
+    r->pending = 0;
+    loop.fd = fd;
+    loop.ring = r;
+    return true;
+}
+
+static void uring_poll(eventLoop &loop, int timeoutMs) {
+    uringState *r = loop.ring;
+    if (timeoutMs > 0) {
+        struct io_uring_sqe *sqe = uring_sqe(loop);
+        r->ts.tv_sec = timeoutMs / 1000;
+        r->ts.tv_nsec = (long long) (timeoutMs % 1000) * 1000000;
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->addr = (uint64_t) (uintptr_t) &r->ts;
+        sqe->len = 1;
+        sqe->off = 1; // also completes as soon as any poll does
+        sqe->user_data = URING_TAG_IGNORE;
+    }
+    uring_flush(loop, timeoutMs == 0 ? 0 : 1);
+
+    // copy completions out first, handlers may queue new sqes
+    vector<pair<uint64_t,int> > done;
+    unsigned head = *r->cqHead;
+    unsigned tail = __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        struct io_uring_cqe &cqe = r->cqes[head & *r->cqMask];
+        if (cqe.user_data != URING_TAG_IGNORE) {
+            done.push_back(make_pair((uint64_t) cqe.user_data, cqe.res));
+        }
+    }
+    __atomic_store_n(r->cqHead, head, __ATOMIC_RELEASE);
+
+    for (int i = 0; i < done.size(); i++) {
+        int fd = (int) (uint32_t) done[i].first;
+        uint32_t gen = (uint32_t) (done[i].first >> 32);
+        int res = done[i].second;
+        if (res >= 0) {
+            int events = 0;
+            if (res & (POLLIN | POLLERR | POLLHUP)) events |= EV_READ;
+            if (res & (POLLOUT | POLLERR | POLLHUP)) events |= EV_WRITE;
+            dispatch(loop, fd, gen, events);
+        } else if (debug_mode) {
+            debug_msg("io_uring poll failed:", strerror(-res));
+        }
+        // a failed poll is armed again too, or the watch would never fire;
+        // one we disarmed has an older gen and stays dead
+        map<int, eventWatch>::iterator it = loop.watches.find(fd);
+        if (it != loop.watches.end() && it->second.gen == gen) uring_arm(loop, it->second);
+    }
+}
+#else
+struct uringState {};
+static bool uring_setup(eventLoop &loop) { return false; }
+static void uring_arm(eventLoop &loop, eventWatch &w) {}
+static void uring_disarm(eventLoop &loop, eventWatch &w) {}
+static void uring_poll(eventLoop &loop, int timeoutMs) {}
+#endif
+
+//===== epoll backend =======
+static uint32_t epoll_mask(int events) {
+    uint32_t mask = 0;
+    if (events & EV_READ) mask |= EPOLLIN;
+    if (events & EV_WRITE) mask |= EPOLLOUT;
+    return mask;
+}
+
+static void epoll_update(eventLoop &loop, int op, int fd, int events) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = epoll_mask(events);
+    ev.data.fd = fd;
+    if (epoll_ctl(loop.fd, op, fd, &ev) < 0) throwSysError("epoll_ctl failed");
+}
+
+static void epoll_poll(eventLoop &loop, int timeoutMs) {
+    struct epoll_event evs[EV_MAX_EVENTS];
+    int count = epoll_wait(loop.fd, evs, EV_MAX_EVENTS, timeoutMs);
+    if (count < 0) {
+        if (errno != EINTR) throwSysError("epoll_wait failed");
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        int events = 0;
+        if (evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) events |= EV_READ;
+        if (evs[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) events |= EV_WRITE;
+        map<int, eventWatch>::iterator it = loop.watches.find(evs[i].data.fd);
+        if (it != loop.watches.end()) dispatch(loop, it->first, it->second.gen, events);
+    }
+}
+
+//===== common =======
+static void dispatch(eventLoop &loop, int fd, uint32_t gen, int events) {
+    map<int, eventWatch>::iterator it = loop.watches.find(fd);
+    if (it == loop.watches.end() || it->second.gen != gen) return;
+    eventWatch w = it->second; // the handler may remove the watch
+    events &= w.events;
+    if (events == 0) return;
+    if (w.timer) {
+        uint64_t expirations;
+        if (read(fd, &expirations, sizeof(expirations)) < 0) return;
+    }
+    w.handler(fd, events, w.arg);
+}
+
+void event_init(eventLoop &loop, eventBackend backend) {
+    loop.running = false;
+    loop.ring = NULL;
+    loop.afterPoll = NULL;
+    loop.backend = backend;
+    if (backend == EV_URING && !uring_setup(loop)) {
+        if (debug_mode) debug_msg("io_uring unavailable, falling back to epoll");
+        loop.backend = EV_EPOLL;
+    }
+    if (loop.backend == EV_EPOLL) {
+        loop.fd = epoll_create1(EPOLL_CLOEXEC);
+        if (loop.fd < 0) throwSysError("epoll_create1 failed");
+    }
+    if (debug_mode) debug_msg("Event loop backend:", event_backendName(loop.backend));
+}
+
+void event_add(eventLoop &loop, int fd, int events, eventHandler handler, void *arg) {
+    eventWatch w = { fd, events, false, 0, handler, arg };
+    loop.watches[fd] = w;
+    if (loop.backend == EV_EPOLL) epoll_update(loop, EPOLL_CTL_ADD, fd, events);
+    else uring_arm(loop, loop.watches[fd]);
+}
+
+void event_mod(eventLoop &loop, int fd, int events) {
+    map<int, eventWatch>::iterator it = loop.watches.find(fd);
+    if (it == loop.watches.end() || it->second.events == events) return;
+    it->second.events = events;
+    if (loop.backend == EV_EPOLL) {
+        epoll_update(loop, EPOLL_CTL_MOD, fd, events);
+    } else {
+        uring_disarm(loop, it->second);
+        uring_arm(loop, it->second);
+    }
+}
+
+void event_del(eventLoop &loop, int fd) {
+    map<int, eventWatch>::iterator it = loop.watches.find(fd);
+    if (it == loop.watches.end()) return;
+    if (loop.backend == EV_EPOLL) epoll_ctl(loop.fd, EPOLL_CTL_DEL, fd, NULL);
+    else uring_disarm(loop, it->second);
+    loop.watches.erase(it);
+}
+
+// periodic timer backed by a timerfd, returns the fd
+int event_addTimer(eventLoop &loop, long intervalUs, eventHandler handler, void *arg) {
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tfd < 0) throwSysError("timerfd_create failed");
+    event_setTimer(tfd, intervalUs);
+    event_add(loop, tfd, EV_READ, handler, arg);
+    loop.watches[tfd].timer = true;
+    return tfd;
+}
+
+// re-arm a timer with a new period, 0 disarms it
+void event_setTimer(int tfd, long intervalUs) {
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = intervalUs / 1000000;
+    spec.it_interval.tv_nsec = (intervalUs % 1000000) * 1000;
+    spec.it_value = spec.it_interval;
+    if (timerfd_settime(tfd, 0, &spec, NULL) < 0) throwSysError("timerfd_settime failed");
+}
+
+void event_setAfterPoll(eventLoop &loop, void (*hook)()) {
+    loop.afterPoll = hook;
+}
+
+// wait up to timeoutMs (-1 forever) and run the handlers of whatever fired
+void event_poll(eventLoop &loop, int timeoutMs) {
+    if (loop.backend == EV_EPOLL) epoll_poll(loop, timeoutMs);
+    else uring_poll(loop, timeoutMs);
+    if (loop.afterPoll != NULL) loop.afterPoll();
+}
+
+void event_run(eventLoop &loop) {
+    loop.running = true;
+    while (loop.running) event_poll(loop, -1);
+}
+
+void event_stop(eventLoop &loop) {
+    loop.running = false;
+}
+
+const char *event_backendName(eventBackend backend) {
+    return backend == EV_URING ? "io_uring" : "epoll";
+}
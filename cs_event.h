@@ -0,0 +1,45 @@
+#ifndef __cs_event_h_
+#define __cs_event_h_
+#include "cs_common.h"
+
+#define EV_READ 1
+#define EV_WRITE 2
+
+enum eventBackend { EV_EPOLL, EV_URING };
+
+// called with the fd and the EV_* flags that fired; for timers the flags are EV_READ
+typedef void (*eventHandler)(int fd, int events, void *arg);
+
+struct eventWatch {
+    int fd;
+    int events;
+    bool timer; // timerfd, expirations are consumed before calling the handler
+    uint32_t gen; // io_uring: tags the armed poll so stale completions are dropped
+    eventHandler handler;
+    void *arg;
+};
+
+struct uringState;
+
+struct eventLoop {
+    eventBackend backend;
+    int fd; // epoll instance or io_uring ring
+    bool running;
+    map<int, eventWatch> watches;
+    uringState *ring;
+    void (*afterPoll)(); // runs after the handlers of every round
+};
+
+void event_init(eventLoop &loop, eventBackend backend);
+void event_add(eventLoop &loop, int fd, int events, eventHandler handler, void *arg);
+void event_mod(eventLoop &loop, int fd, int events);
+void event_del(eventLoop &loop, int fd);
+int event_addTimer(eventLoop &loop, long intervalUs, eventHandler handler, void *arg);
+void event_setTimer(int tfd, long intervalUs);
+void event_setAfterPoll(eventLoop &loop, void (*hook)());
+void event_poll(eventLoop &loop, int timeoutMs);
+void event_run(eventLoop &loop);
+void event_stop(eventLoop &loop);
+const char *event_backendName(eventBackend backend);
+
+#endif
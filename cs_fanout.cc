@@ -0,0 +1,81 @@
+#include "cs_fanout.h"
+#include "cs_metrics.h"
+#include "cs_transport.h"
+#include "cs_sendq.h"
+#include <errno.h>
+
+thread_local fanoutStats fstats;
+
+static thread_local struct mmsghdr msgs[FANOUT_BATCH];
+static thread_local struct iovec iov;
+
+// the socket is full: the rest waits in the send queues, sharing one copy
+static void fanout_queue(const struct sockaddr_in *dests, int count, const char *buf, size_t len) {
+    msgRef copy = msgref_copy(buf, len);
+    for (int i = 0; i < count; i++) sendq_push(dests[i], copy);
+}
+
+// send the same payload to every destination, FANOUT_BATCH datagrams per syscall.
+// returns the number of datagrams that went out or wait in a send queue
+int fanout_send(int fd, const struct sockaddr_in *dests, int count,
+                const char *buf, size_t len) {
+    if (sendq_busy()) {
+        fanout_queue(dests, count, buf, len);
+        return count;
+    }
+    iov.iov_base = (void*) buf;
+    iov.iov_len = len;
+    int sent = 0, failed = 0;
+    while (sent < count) {
+        int batch = min(count - sent, FANOUT_BATCH);
+        for (int i = 0; i < batch; i++) {
+            struct msghdr &hdr = msgs[i].msg_hdr;
+            hdr.msg_name = (void*) &dests[sent + i];
+            hdr.msg_namelen = sizeof(struct sockaddr_in);
+            hdr.msg_iov = &iov;
+            hdr.msg_iovlen = 1;
+            hdr.msg_control = NULL;
+            hdr.msg_controllen = 0;
+            hdr.msg_flags = 0;
+        }
+        int done = 0;
+        while (done < batch) {
+            int status = net_sendmmsg(fd, msgs + done, batch - done, 0);
+            fstats.calls++;
+            if (done > 0) fstats.retries++;
+            if (status < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+                    fanout_queue(dests + sent + done, count - sent - done, buf, len);
+                    return count - failed;
+                }
+                // the first datagram of the batch failed, skip it and go on
+                fstats.errors++;
+                metric_add(metrics_local().sendErrors);
+                failed++;
+                if (debug_mode) debug_msg("Error delivering packet to",
+                                    formatAddress(toAddress(dests[sent + done])).c_str());
+                done++;
+                continue;
+            }
+            fstats.datagrams += status;
+            if (debug_mode) debug_msg("sendmmsg carried datagrams:", status);
+            done += status;
+        }
+        sent += batch;
+    }
+    return sent - failed;
+}
+
+void fanout_buildDests(vector<address> const &list, vector<struct sockaddr_in> &out) {
+    out.resize(list.size());
+    for (int i = 0; i < list.size(); i++) {
+        out[i] = toSockaddr(list[i]);
+    }
+}
+
+void printFanoutStats() {
+    cout << "sendmmsg calls | datagrams | retries | errors" << endl;
+    cout << fstats.calls << " | " << fstats.datagrams << " | "
+         << fstats.retries << " | " << fstats.errors << endl;
+}
@@ -0,0 +1,22 @@
+#ifndef __cs_fanout_h_
+#define __cs_fanout_h_
+#include "cs_common.h"
+
+// max datagrams handed to a single sendmmsg call
+#define FANOUT_BATCH 1024
+
+struct fanoutStats {
+    long calls;     // sendmmsg syscalls issued
+    long datagrams; // datagrams carried by those syscalls
+    long retries;   // calls needed to finish a partially sent batch
+    long errors;    // datagrams dropped because of a send error
+};
+
+extern thread_local fanoutStats fstats;
+
+int fanout_send(int fd, const struct sockaddr_in *dests, int count,
+                const char *buf, size_t len);
+void fanout_buildDests(vector<address> const &list, vector<struct sockaddr_in> &out);
+void printFanoutStats();
+
+#endif
@@ -0,0 +1,98 @@
+#include "cs_fifo.h"
+
+bool operator == (const fifoKey &a, const fifoKey &b) {
+    return a.sender == b.sender && a.roomId == b.roomId;
+}
+
+size_t fifoKeyHash::operator () (const fifoKey &k) const {
+    return (size_t) ((k.sender ^ ((uint64_t) k.roomId << 48)) * 0x9E3779B97F4A7C15ULL);
+}
+
+fifoKey fifo_key(address sender, int roomId) {
+    fifoKey k = { ((uint64_t) sender.addr << 16) | sender.port, roomId };
+    return k;
+}
+
+// park a message that arrived early, false if it is past the window
+// or already parked
+bool fifo_hold(fifoStream &s, int msgId, msgRef const &msg) {
+    if (msgId <= 0 || msgId - s.lastMsgId > FIFO_WINDOW) return false;
+    if (s.slots.empty()) {
+        s.slots.resize(FIFO_WINDOW);
+        s.present.resize(FIFO_WINDOW);
+    }
+    int i = msgId % FIFO_WINDOW;
+    if (s.present[i]) return false;
+    s.slots[i] = msg;
+    s.present[i] = true;
+    s.buffered++;
+    return true;
+}
+
+// stop waiting for the missing messages up to upTo: a message too far
+// ahead to hold, or one stamped where the stream starts for us. the caller
+// delivers what is parked behind each gap as it goes (fifo_ready), returns
+// the messages skipped
+int fifo_resync(fifoStream &s, int upTo) {
+    int skipped = 0;
+    while (s.lastMsgId < upTo && !fifo_ready(s)) {
+        if (s.buffered == 0) {
+            // nothing parked, jump straight there
+            skipped += upTo - s.lastMsgId;
+            s.lastMsgId = upTo;
+            break;
+        }
+        fifo_advance(s);
+        skipped++;
+    }
+    return skipped;
+}
+
+// is the next message in sequence parked?
+bool fifo_ready(fifoStream &s) {
+    return s.buffered > 0 && s.present[(s.lastMsgId + 1) % FIFO_WINDOW];
+}
+
+msgRef &fifo_front(fifoStream &s) {
+    return s.slots[(s.lastMsgId + 1) % FIFO_WINDOW];
+}
+
+// the next message was delivered, free its slot if it had one
+void fifo_advance(fifoStream &s) {
+    s.lastMsgId++;
+    if (s.buffered == 0) return;
+    int i = s.lastMsgId % FIFO_WINDOW;
+    if (s.present[i]) {
+        s.present[i] = false;
+        s.slots[i] = msgRef();
+        s.buffered--;
+    }
+}
+
+// forget every stream of a room, returns the messages they held
+int fifo_dropRoom(unordered_map<fifoKey, fifoStream, fifoKeyHash> &streams, int roomId) {
+    int held = 0;
+    unordered_map<fifoKey, fifoStream, fifoKeyHash>::iterator it = streams.begin();
+    while (it != streams.end()) {
+        if (it->first.roomId == roomId) {
+            held += it->second.buffered;
+            it = streams.erase(it);
+        } else {
+            it++;
+        }
+    }
+    return held;
+}
+
+// debugging helper method
+void printFifoStreams(unordered_map<fifoKey, fifoStream, fifoKeyHash> &streams) {
+    int buffered = 0, waiting = 0;
+    unordered_map<fifoKey, fifoStream, fifoKeyHash>::iterator it;
+    for (it = streams.begin(); it != streams.end(); it++) {
+        buffered += it->second.buffered;
+        if (it->second.buffered > 0) waiting++;
+    }
+    string text = to_string(streams.size()) + " streams, " + to_string(waiting) +
+                  " waiting for a gap, " + to_string(buffered) + " messages held";
+    debug_msg("FIFO state:", text.c_str());
+}
@@ -0,0 +1,19 @@
+#ifndef __cs_fifo_h_
+#define __cs_fifo_h_
+#include "cs_common.h"
+
+// FIFO reorder window: messages ahead of the next expected one wait in a
+// ring indexed by msgId % FIFO_WINDOW; one further ahead than that gives up
+// on the gap (fifo_resync)
+#define FIFO_WINDOW 256
+
+fifoKey fifo_key(address sender, int roomId);
+bool fifo_hold(fifoStream &s, int msgId, msgRef const &msg);
+int fifo_resync(fifoStream &s, int upTo);
+bool fifo_ready(fifoStream &s);
+msgRef &fifo_front(fifoStream &s);
+void fifo_advance(fifoStream &s);
+int fifo_dropRoom(unordered_map<fifoKey, fifoStream, fifoKeyHash> &streams, int roomId);
+void printFifoStreams(unordered_map<fifoKey, fifoStream, fifoKeyHash> &streams);
+
+#endif
@@ -0,0 +1,109 @@
+#include "cs_frag.h"
+#include "cs_fanout.h"
+#include "cs_shard.h"
+
+static thread_local int lastFragId = 0;
+
+void frag_init(fragPool &pool, int slots) {
+    pool.slots.assign(slots, fragSlot());
+    pool.freeSlots.clear();
+    for (int i = slots - 1; i >= 0; i--) pool.freeSlots.push_back(i);
+    pool.reassembled = pool.dropped = 0;
+}
+
+// sends an encoded server message, in pieces if it does not fit one frame.
+// text format peers know no fragments, they get the datagram as it is.
+// each piece is put together in a frame of its own, buf may be shared.
+// returns the datagrams sent to each destination
+int frag_send(int fd, const struct sockaddr_in *dests, int count, int roomId,
+               const char *buf, int len) {
+    if (len <= MSG_BUFSIZE || wire_text) {
+        fanout_send(fd, dests, count, buf, len);
+        return 1;
+    }
+    if (len > WIRE_MAXSIZE) {
+        if (debug_mode) debug_msg("Message too large to fragment, bytes:", len);
+        return 0;
+    }
+    // workers of one server share its address, keep their ids apart
+    int fragId = (workerId << 24) | (++lastFragId & 0xffffff);
+    static thread_local char frame[MSG_BUFSIZE];
+    for (int off = 0; off < len; off += FRAG_CHUNK) {
+        wireMsg m = wire_make(WIRE_FRAGMENT, roomId, buf + off, min(FRAG_CHUNK, len - off));
+        m.msgId = fragId;
+        m.seq = off;
+        m.stamp = len;
+        int n = wire_encode(m, frame, sizeof(frame));
+        fanout_send(fd, dests, count, frame, n);
+    }
+    if (debug_mode) debug_msg("Sent message in fragments, bytes:", len);
+    return (len + FRAG_CHUNK - 1) / FRAG_CHUNK;
+}
+
+static void freeSlot(fragPool &pool, int slot) {
+    pool.slots[slot].used = false;
+    pool.slots[slot].buf = msgRef();
+    pool.freeSlots.push_back(slot);
+}
+
+static int findSlot(fragPool &pool, address sender, int fragId) {
+    for (int i = 0; i < pool.slots.size(); i++) {
+        fragSlot &s = pool.slots[i];
+        if (s.used && s.fragId == fragId && s.sender == sender) return i;
+    }
+    return -1;
+}
+
+// stores one fragment, true once the datagram is complete and in whole
+bool frag_add(fragPool &pool, address sender, wireMsg const &m, msgRef &whole) {
+    int total = m.stamp, off = m.seq;
+    if (total <= MSG_BUFSIZE || total > WIRE_MAXSIZE || off < 0 || off % FRAG_CHUNK != 0 ||
+        off >= total || m.len != min(FRAG_CHUNK, total - off)) {
+        if (debug_mode) debug_msg("Dropped malformed fragment");
+        return false;
+    }
+    int slot = findSlot(pool, sender, m.msgId);
+    if (slot < 0) {
+        if (pool.freeSlots.empty()) {
+            pool.dropped++;
+            if (debug_mode) debug_msg("No reassembly slot left, dropped fragment");
+            return false;
+        }
+        slot = pool.freeSlots.back();
+        pool.freeSlots.pop_back();
+        fragSlot &s = pool.slots[slot];
+        s.used = true;
+        s.buf = msgref_alloc(total);
+        s.sender = sender;
+        s.fragId = m.msgId;
+        s.total = total;
+        s.have = 0;
+        s.parts = 0;
+        s.age = 0;
+    }
+    fragSlot &s = pool.slots[slot];
+    int part = off / FRAG_CHUNK;
+    if (part >= FRAG_MAXPARTS) return false;
+    uint64_t bit = 1ULL << part;
+    if (s.total != total || (s.parts & bit)) return false;
+    memcpy(msgref_writable(s.buf) + off, m.payload, m.len);
+    s.parts |= bit;
+    s.have += m.len;
+    s.age = 0;
+    if (s.have < s.total) return false;
+    pool.reassembled++;
+    whole = std::move(s.buf);
+    freeSlot(pool, slot);
+    return true;
+}
+
+// called every tick: a set that stopped receiving fragments lost one of them
+void frag_expire(fragPool &pool) {
+    for (int i = 0; i < pool.slots.size(); i++) {
+        fragSlot &s = pool.slots[i];
+        if (!s.used || ++s.age < FRAG_MAXAGE) continue;
+        pool.dropped++;
+        if (debug_mode) debug_msg("Dropped incomplete fragment set, bytes missing:", s.total - s.have);
+        freeSlot(pool, i);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef __cs_frag_h_
+#define __cs_frag_h_
+#include "cs_common.h"
+#include "cs_wire.h"
+
+// server-to-server datagrams larger than one ethernet frame are sent as
+// WIRE_FRAGMENT pieces of the encoded message and put back together on
+// the receiving worker. a fragment carries the room id of the message,
+// msgId = fragment set id, seq = offset, stamp = total length
+#define FRAG_CHUNK (MSG_BUFSIZE - WIRE_HEADER) // payload bytes per fragment
+#define FRAG_MAXPARTS ((WIRE_MAXSIZE + FRAG_CHUNK - 1) / FRAG_CHUNK) // pieces of the largest message
+#define FRAG_POOL_SLOTS 32 // reassemblies in progress per worker
+#define FRAG_MAXAGE 2 // ticks without a new fragment before a set is dropped
+
+struct fragSlot {
+    bool used;
+    msgRef buf; // large pool buffer the pieces are copied into
+    address sender;
+    int fragId;
+    int total; // length of the whole datagram
+    int have;  // bytes received so far
+    uint64_t parts; // bit per fragment received
+    int age;
+};
+
+static_assert(FRAG_MAXPARTS <= 8 * sizeof(uint64_t), "fragments of a message must fit fragSlot::parts");
+
+// reassemblies in progress, the buffers come from the message pool
+struct fragPool {
+    vector<fragSlot> slots;
+    vector<int> freeSlots;
+    long reassembled, dropped;
+};
+
+void frag_init(fragPool &pool, int slots);
+int frag_send(int fd, const struct sockaddr_in *dests, int count, int roomId,
+               const char *buf, int len);
+bool frag_add(fragPool &pool, address sender, wireMsg const &m, msgRef &whole);
+void frag_expire(fragPool &pool);
+
+#endif
@@ -0,0 +1,173 @@
+#include "cs_group.h"
+#include "cs_order.h"
+#include "cs_index.h"
+#include "cs_metrics.h"
+
+int group_routing = 0;
+
+struct groupRoom {
+    int epoch; // our joins and leaves of the room so far, odd while we have members
+    map<int,int> epochs; // server index -> latest epoch heard from it
+    bool joining; // our latest join is being ordered, our rounds wait for the view
+    int joinId; // message id of our latest join
+    bool delivering; // our latest join has been delivered, what follows goes out
+    vector<pair<address,int> > deferred; // joins (server, msgId) still owed a proposal
+};
+
+static thread_local map<int, groupRoom> groups; // chatroom to group
+
+bool group_enabled() {
+    return group_routing && !wire_text && order_mode == 2;
+}
+
+static int peerIndex(address server) {
+    indexEntry *e = index_find(endpoints, server);
+    if (e == NULL || e->kind != INDEX_PEER) return -1;
+    return e->peer;
+}
+
+static void learn(groupRoom &g, int peer, int epoch) {
+    int &known = g.epochs[peer];
+    known = max(known, epoch);
+}
+
+// one of our rounds in the room did not ask the server
+static bool excludes(int roomId, int peer) {
+    map<int, total_s>::iterator st = totalSenderMap.find(roomId);
+    if (st == totalSenderMap.end()) return false;
+    map<int, total_round>::iterator it;
+    for (it = st->second.inflight.begin(); it != st->second.inflight.end(); it++) {
+        vector<int> const &peers = it->second.peers;
+        if (!it->second.join && find(peers.begin(), peers.end(), peer) == peers.end()) return true;
+    }
+    return false;
+}
+
+// our proposal for a join goes past every agreed timestamp we know of,
+// the join is not held here
+static void propose(int roomId, groupRoom &g, address joiner, int msgId) {
+    total_r &rInfo = totalReceiverMap[roomId];
+    rInfo.P = max(rInfo.P, rInfo.A) + 1;
+    wireMsg p = wire_make(WIRE_PROPOSAL, roomId, NULL, 0);
+    p.seq = rInfo.P;
+    p.msgId = msgId;
+    p.stamp = g.epoch;
+    sendToServer(joiner, p);
+    if (debug_mode) debug_msg("Proposed for a join ", rInfo.P);
+}
+
+// an ordering round over every server with an empty message in our own
+// holdback queue: whatever orders after it is ours to deliver
+static void startJoin(int roomId, groupRoom &g) {
+    total_s &sInfo = totalSenderMap[roomId];
+    int msgId = ++sInfo.nextId;
+    g.joining = true;
+    g.joinId = msgId;
+    g.delivering = false;
+    total_round &round = sInfo.inflight[msgId];
+    round.batched = false;
+    round.join = true;
+    round.need = N;
+    total_r &rInfo = totalReceiverMap[roomId];
+    rInfo.P = max(rInfo.P, rInfo.A) + 1;
+    round.startUs = metrics_nowUs();
+    totalMsg mark = { rInfo.P, selfAddr, round.msg, false, msgId, false, round.startUs, true };
+    total_holdback(rInfo.queue, mark);
+    round.T = rInfo.P;
+    round.responses[selfAddr] = rInfo.P;
+    wireMsg m = wire_make(WIRE_GROUP, roomId, NULL, 0);
+    m.seq = g.epoch;
+    m.msgId = msgId;
+    forwardToServers(m);
+    if (round.responses.size() == round.need) total_sendFinal(roomId, msgId);
+}
+
+// local member count of a room left zero (members) or dropped back to it
+void group_changed(int roomId, bool members) {
+    if (!group_enabled()) return;
+    groupRoom &g = groups[roomId];
+    g.epoch++;
+    if (members) {
+        startJoin(roomId, g);
+    } else {
+        g.delivering = false;
+        wireMsg m = wire_make(WIRE_GROUP, roomId, NULL, 0);
+        m.seq = g.epoch;
+        forwardToServers(m);
+    }
+    if (debug_mode) debug_msg(members ? "Joining the group of room #" :
+                              "Left the group of room #", roomId);
+}
+
+// another server joined (msgId set, wants a proposal) or left the room
+void group_handle(address sender, wireMsg const &m) {
+    int peer = peerIndex(sender);
+    if (!group_enabled() || peer < 0) {
+        if (debug_mode) debug_msg("Ignored group change for room #", m.roomId);
+        return;
+    }
+    groupRoom &g = groups[m.roomId];
+    learn(g, peer, m.seq);
+    if (m.msgId == 0) return;
+    if (excludes(m.roomId, peer)) {
+        g.deferred.push_back(make_pair(sender, m.msgId));
+        if (debug_mode) debug_msg("Join waits for our rounds in room #", m.roomId);
+        return;
+    }
+    propose(m.roomId, g, sender, m.msgId);
+}
+
+// a proposal for our join says whether the server has members
+void group_learn(int roomId, address sender, int epoch) {
+    int peer = peerIndex(sender);
+    if (epoch <= 0 || peer < 0) return;
+    learn(groups[roomId], peer, epoch);
+}
+
+// false while our join is being ordered: we do not know the view yet, and
+// our lines have to order after the join
+bool group_ready(int roomId) {
+    if (!group_enabled()) return true;
+    map<int, groupRoom>::iterator it = groups.find(roomId);
+    return it == groups.end() || !it->second.joining;
+}
+
+// servers that have members in the room, by index
+void group_peers(int roomId, vector<int> &out) {
+    out.clear();
+    groupRoom &g = groups[roomId];
+    map<int,int>::iterator it;
+    for (it = g.epochs.begin(); it != g.epochs.end(); it++) {
+        if ((it->second & 1) && it->first != nn-1) out.push_back(it->first);
+    }
+}
+
+// one of our rounds in the room is final: joins waiting on it get their
+// proposal, our own join lets our lines go
+void group_roundDone(int roomId, int msgId) {
+    if (!group_enabled()) return;
+    groupRoom &g = groups[roomId];
+    if (msgId == g.joinId) g.joining = false;
+    int i = 0;
+    while (i < g.deferred.size()) {
+        pair<address,int> join = g.deferred[i];
+        if (excludes(roomId, peerIndex(join.first))) {
+            i++;
+            continue;
+        }
+        g.deferred.erase(g.deferred.begin() + i);
+        propose(roomId, g, join.first, join.second);
+    }
+}
+
+// false for what orders before our join, and for the join itself
+bool group_deliver(int roomId, totalMsg const &m) {
+    if (!group_enabled()) return true;
+    map<int, groupRoom>::iterator it = groups.find(roomId);
+    if (it == groups.end()) return false;
+    if (m.join) {
+        if (m.msgId == it->second.joinId) it->second.delivering = true;
+        return false;
+    }
+    return it->second.delivering;
+}
@@ -0,0 +1,29 @@
+#ifndef __cs_group_h_
+#define __cs_group_h_
+#include "cs_common.h"
+#include "cs_wire.h"
+
+// per-room ISIS groups (total ordering, binary wire format): a round only
+// asks the servers that have members in the room, so its latency follows the
+// room's footprint and not the cluster size.
+// every server numbers its joins and leaves of a room (odd epoch: it has
+// members) and tells every other server with WIRE_GROUP.
+// join: an ordering round over all servers whose proposals carry each
+// server's epoch, which gives the joiner its view. a server includes the
+// joiner in every round it starts from the moment the join arrives, and
+// proposes only once its own rounds without the joiner are final, so all of
+// those order before the join. the joiner delivers what orders after it.
+// leave: the others stop asking the server; rounds already under way still
+// get its proposal, it just has nobody to deliver to
+extern int group_routing;
+
+bool group_enabled();
+void group_changed(int roomId, bool members);
+void group_handle(address sender, wireMsg const &m);
+void group_learn(int roomId, address sender, int epoch);
+bool group_ready(int roomId);
+void group_peers(int roomId, vector<int> &out);
+void group_roundDone(int roomId, int msgId);
+bool group_deliver(int roomId, totalMsg const &m);
+
+#endif
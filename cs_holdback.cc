@@ -0,0 +1,60 @@
+#include "cs_holdback.h"
+
+bool operator < (const holdbackKey &a, const holdbackKey &b) {
+    return tie(a.timestamp, a.node.addr, a.node.port, a.msgId, a.slot) <
+           tie(b.timestamp, b.node.addr, b.node.port, b.msgId, b.slot);
+}
+
+// messages stay in their slot while their key moves around in the index
+void holdback_push(holdbackQueue &q, totalMsg const &m) {
+    int slot;
+    if (!q.freeSlots.empty()) {
+        slot = q.freeSlots.back();
+        q.freeSlots.pop_back();
+        q.entries[slot] = m;
+    } else {
+        slot = q.entries.size();
+        q.entries.push_back(m);
+    }
+    holdbackKey key = { m.timestamp, m.node, m.msgId, slot };
+    q.order.insert(key);
+    if (!m.deliverable) q.byProposal[m.timestamp] = slot;
+}
+
+// the message proposed as oldP gets its final timestamp T and becomes
+// deliverable, false if there is no such message
+bool holdback_finalize(holdbackQueue &q, int oldP, int T) {
+    unordered_map<int,int>::iterator it = q.byProposal.find(oldP);
+    if (it == q.byProposal.end()) return false;
+    int slot = it->second;
+    q.byProposal.erase(it);
+    totalMsg &m = q.entries[slot];
+    holdbackKey key = { m.timestamp, m.node, m.msgId, slot };
+    q.order.erase(key);
+    m.timestamp = T;
+    m.deliverable = true;
+    key.timestamp = T;
+    q.order.insert(key);
+    return true;
+}
+
+bool holdback_empty(holdbackQueue const &q) {
+    return q.order.empty();
+}
+
+int holdback_size(holdbackQueue const &q) {
+    return q.order.size();
+}
+
+totalMsg &holdback_front(holdbackQueue &q) {
+    return q.entries[q.order.begin()->slot];
+}
+
+void holdback_pop(holdbackQueue &q) {
+    int slot = q.order.begin()->slot;
+    q.order.erase(q.order.begin());
+    totalMsg &m = q.entries[slot];
+    if (!m.deliverable) q.byProposal.erase(m.timestamp);
+    m.msg = msgRef();
+    q.freeSlots.push_back(slot);
+}
@@ -0,0 +1,14 @@
+#ifndef __cs_holdback_h_
+#define __cs_holdback_h_
+#include "cs_common.h"
+
+// total ordering holdback queue: O(log n) insert and reorder, O(1) front,
+// O(1) lookup of an undeliverable message by the timestamp proposed for it
+void holdback_push(holdbackQueue &q, totalMsg const &m);
+bool holdback_finalize(holdbackQueue &q, int oldP, int T);
+bool holdback_empty(holdbackQueue const &q);
+int holdback_size(holdbackQueue const &q);
+totalMsg &holdback_front(holdbackQueue &q);
+void holdback_pop(holdbackQueue &q);
+
+#endif
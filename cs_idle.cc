@@ -0,0 +1,49 @@
+#include "cs_idle.h"
+#include "cs_client.h"
+#include "cs_metrics.h"
+
+int idle_timeout = 0;
+thread_local timerWheel idleWheel; // ticks of IDLE_TICK_US since the worker started
+static thread_local uint64_t startUs;
+
+static uint64_t timeoutTicks() {
+    return (uint64_t) idle_timeout * 1000000 / IDLE_TICK_US;
+}
+
+// catches up by real time, a late timer just fires more ticks at once
+static void onIdleTick(int fd, int events, void *arg) {
+    wheel_advance(idleWheel, (metrics_nowUs() - startUs) / IDLE_TICK_US);
+}
+
+void idle_init(eventLoop &loop) {
+    wheel_init(idleWheel);
+    if (idle_timeout <= 0) return;
+    startUs = metrics_nowUs();
+    event_addTimer(loop, IDLE_TICK_US, onIdleTick, NULL);
+}
+
+static void onExpired(void *arg) {
+    clientInfo &client = *(clientInfo*) arg;
+    uint64_t due = client.lastSeen + timeoutTicks();
+    if (due > idleWheel.now) { // seen since the timer was set
+        wheel_add(idleWheel, &client.idle, due);
+        return;
+    }
+    metric_add(metrics_local().evicted);
+    if (debug_mode) debug_msg("Removing idle client", client.id.c_str());
+    sendResponse(client.addr, "-ERR Idle for too long, you have been removed");
+    client_quit(client);
+}
+
+// a new client, on the worker that receives its datagrams
+void idle_watch(clientInfo &client) {
+    if (idle_timeout <= 0) return;
+    client.lastSeen = idleWheel.now;
+    client.idle.fire = onExpired;
+    client.idle.arg = &client;
+    wheel_add(idleWheel, &client.idle, idleWheel.now + timeoutTicks());
+}
+
+void idle_forget(clientInfo &client) {
+    wheel_del(&client.idle);
+}
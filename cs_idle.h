@@ -0,0 +1,23 @@
+#ifndef __cs_idle_h_
+#define __cs_idle_h_
+#include "cs_common.h"
+#include "cs_event.h"
+
+// idle sessions: a client that sends nothing for idle_timeout seconds is
+// removed as if it had sent /quit. each client has a timer on its worker's
+// wheel (cs_wheel.h); a datagram only records the current tick, the timer
+// looks at it when it fires and is set again if the client was seen since
+#define IDLE_TICK_US 100000
+
+extern int idle_timeout; // seconds, 0 keeps clients until /quit
+extern thread_local timerWheel idleWheel;
+
+void idle_init(eventLoop &loop);
+void idle_watch(clientInfo &client);
+void idle_forget(clientInfo &client);
+
+inline void idle_seen(clientInfo &client) {
+    client.lastSeen = idleWheel.now;
+}
+
+#endif
@@ -0,0 +1,72 @@
+#include "cs_index.h"
+
+#define INDEX_TOMBSTONE (~(uint64_t) 0) // no 48-bit key can collide with it
+#define INDEX_MIN_SLOTS 64
+
+static uint64_t packKey(address a) {
+    return ((uint64_t) a.addr << 16) | a.port;
+}
+
+// fibonacci hashing, spreads neighbouring ports across the table
+static size_t slotOf(addrIndex &idx, uint64_t key) {
+    return (size_t) ((key * 0x9E3779B97F4A7C15ULL) >> 17) & (idx.slots.size() - 1);
+}
+
+static void rehash(addrIndex &idx, size_t size) {
+    vector<indexEntry> old;
+    old.swap(idx.slots);
+    idx.slots.assign(size, indexEntry());
+    idx.used = idx.live;
+    for (int i = 0; i < old.size(); i++) {
+        if (old[i].key == 0 || old[i].key == INDEX_TOMBSTONE) continue;
+        size_t s = slotOf(idx, old[i].key);
+        while (idx.slots[s].key != 0) s = (s + 1) & (size - 1);
+        idx.slots[s] = old[i];
+    }
+}
+
+indexEntry *index_find(addrIndex &idx, address a) {
+    if (idx.slots.empty()) return NULL;
+    uint64_t key = packKey(a);
+    size_t mask = idx.slots.size() - 1;
+    for (size_t s = slotOf(idx, key); idx.slots[s].key != 0; s = (s + 1) & mask) {
+        if (idx.slots[s].key == key) return &idx.slots[s];
+    }
+    return NULL;
+}
+
+// entry for a, created empty if missing. pointers stay valid until the next insert
+indexEntry *index_insert(addrIndex &idx, address a) {
+    indexEntry *found = index_find(idx, a);
+    if (found != NULL) return found;
+    // keep the load (tombstones included) under 70%
+    if (idx.slots.empty()) {
+        idx.used = idx.live = 0;
+        rehash(idx, INDEX_MIN_SLOTS);
+    } else if ((idx.used + 1) * 10 > idx.slots.size() * 7) {
+        size_t size = idx.slots.size();
+        if ((idx.live + 1) * 10 > size * 4) size *= 2; // else tombstones only
+        rehash(idx, size);
+    }
+    uint64_t key = packKey(a);
+    size_t mask = idx.slots.size() - 1;
+    size_t s = slotOf(idx, key);
+    while (idx.slots[s].key != 0 && idx.slots[s].key != INDEX_TOMBSTONE) s = (s + 1) & mask;
+    if (idx.slots[s].key == 0) idx.used++;
+    idx.live++;
+    indexEntry &e = idx.slots[s];
+    e.key = key;
+    e.kind = 0;
+    e.peer = -1;
+    e.client = NULL;
+    e.room = e.slot = -1;
+    return &e;
+}
+
+void index_erase(addrIndex &idx, address a) {
+    indexEntry *e = index_find(idx, a);
+    if (e == NULL) return;
+    e->key = INDEX_TOMBSTONE;
+    e->client = NULL;
+    idx.live--;
+}
@@ -0,0 +1,28 @@
+#ifndef __cs_index_h_
+#define __cs_index_h_
+#include "cs_common.h"
+
+#define INDEX_PEER 1   // another server in the config file
+#define INDEX_CLIENT 2 // client connected to this worker
+#define INDEX_MEMBER 3 // member of a chatroom owned by this worker
+
+// open-addressing (linear probing) table keyed by the packed 48-bit address
+struct indexEntry {
+    uint64_t key; // addr << 16 | port, 0 = empty slot
+    int kind;
+    int peer; // INDEX_PEER: position in the server list
+    clientInfo *client; // INDEX_CLIENT: stable handle into clients
+    int room, slot; // INDEX_MEMBER: the room and the position in its member array
+};
+
+struct addrIndex {
+    vector<indexEntry> slots; // size is a power of two
+    int used; // live entries plus tombstones
+    int live;
+};
+
+indexEntry *index_find(addrIndex &idx, address a);
+indexEntry *index_insert(addrIndex &idx, address a);
+void index_erase(addrIndex &idx, address a);
+
+#endif
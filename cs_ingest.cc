@@ -0,0 +1,70 @@
+#include "cs_ingest.h"
+#include "cs_transport.h"
+#include <errno.h>
+
+// bytes of a small buffer a datagram may fill, the rest goes to the spill
+#define INGEST_HEAD (MSGBUF_SMALL - MSGBUF_HEADROOM - 1)
+
+void ingest_init(ingestSlab &slab, int batch) {
+    slab.batch = batch;
+    slab.bufs.assign(batch, msgRef());
+    slab.spill.assign((size_t) batch * MSG_MAXSIZE, 0);
+    slab.msgs.resize(batch);
+    slab.iovs.resize(2 * batch);
+    slab.srcs.resize(batch);
+    for (int i = 0; i < batch; i++) {
+        slab.iovs[2*i+1].iov_base = &slab.spill[(size_t) i * MSG_MAXSIZE];
+        slab.iovs[2*i+1].iov_len = MSG_MAXSIZE - INGEST_HEAD;
+    }
+}
+
+// fill the slab with up to slab.batch datagrams, returns how many arrived.
+// with MSG_WAITFORONE it blocks for the first one and drains whatever else is queued
+int ingest_recv(int fd, ingestSlab &slab, int flags) {
+    for (int i = 0; i < slab.batch; i++) {
+        if (slab.bufs[i].buf == NULL) slab.bufs[i] = msgref_alloc(INGEST_HEAD);
+        slab.iovs[2*i].iov_base = msgref_writable(slab.bufs[i]);
+        slab.iovs[2*i].iov_len = INGEST_HEAD;
+        struct msghdr &hdr = slab.msgs[i].msg_hdr;
+        hdr.msg_name = &slab.srcs[i];
+        hdr.msg_namelen = sizeof(struct sockaddr_in);
+        hdr.msg_iov = &slab.iovs[2*i];
+        hdr.msg_iovlen = 2;
+        hdr.msg_control = NULL;
+        hdr.msg_controllen = 0;
+        hdr.msg_flags = 0;
+    }
+    int count;
+    do {
+        count = net_recvmmsg(fd, slab.msgs.data(), slab.batch, flags);
+    } while (count < 0 && errno == EINTR);
+    if (count < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && debug_mode) {
+            debug_msg("Error receiving packets");
+        }
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        int len = slab.msgs[i].msg_len;
+        msgRef &r = slab.bufs[i];
+        if (len > INGEST_HEAD) { // the one copy a large datagram costs
+            msgRef big = msgref_alloc(len);
+            char *p = msgref_writable(big);
+            memcpy(p, r.data(), INGEST_HEAD);
+            memcpy(p + INGEST_HEAD, slab.iovs[2*i+1].iov_base, len - INGEST_HEAD);
+            r = big;
+        }
+        r.len = len;
+        msgref_writable(r)[len] = 0;
+    }
+    return count;
+}
+
+// the datagram, the slot will get a new buffer
+msgRef ingest_take(ingestSlab &slab, int i) {
+    return std::move(slab.bufs[i]);
+}
+
+address ingest_src(ingestSlab &slab, int i) {
+    return toAddress(slab.srcs[i]);
+}
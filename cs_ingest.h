@@ -0,0 +1,25 @@
+#ifndef __cs_ingest_h_
+#define __cs_ingest_h_
+#include "cs_common.h"
+
+#define INGEST_DEFAULT_BATCH 32
+
+// receive buffers for one recvmmsg call. every datagram lands in a small
+// pooled msgBuf; a longer one runs over into its spill area and is joined
+// into a large buffer. the handler takes the buffer, the slot gets a fresh
+// one before the next call
+struct ingestSlab {
+    int batch; // max datagrams per recvmmsg
+    vector<msgRef> bufs;
+    vector<char> spill; // batch * MSG_MAXSIZE bytes
+    vector<struct mmsghdr> msgs;
+    vector<struct iovec> iovs; // two per datagram: buffer, spill
+    vector<struct sockaddr_in> srcs;
+};
+
+void ingest_init(ingestSlab &slab, int batch);
+int ingest_recv(int fd, ingestSlab &slab, int flags);
+msgRef ingest_take(ingestSlab &slab, int i);
+address ingest_src(ingestSlab &slab, int i);
+
+#endif
@@ -0,0 +1,186 @@
+#include "cs_interest.h"
+#include "cs_order.h"
+#include "cs_relay.h"
+#include "cs_fifo.h"
+#include "cs_metrics.h"
+#include "cs_shard.h"
+
+int interest_routing = 0;
+
+// room -> server index -> ticks until the interest lapses
+static thread_local map<int, map<int,int> > interest;
+
+struct freshPeer {
+    int ticks; // until the server is no longer new to the room
+    map<address,int> starts; // FIFO sender -> first message number sent there
+};
+
+// room -> server index, servers that announced the room lately
+static thread_local map<int, map<int, freshPeer> > fresh;
+
+bool interest_enabled() {
+    return interest_routing && !wire_text && relay_degree == 0 && order_mode <= 1;
+}
+
+static void announce(int roomId, bool members) {
+    wireMsg m = wire_make(WIRE_INTEREST, roomId, NULL, 0);
+    m.seq = members;
+    m.msgId = nn;
+    forwardToServers(m);
+}
+
+// local member count of a room left zero (members) or dropped back to it
+void interest_changed(int roomId, bool members) {
+    if (!interest_enabled()) return;
+    announce(roomId, members);
+    // no more messages for the room come here; a later member picks up
+    // every stream where the others say it starts (see fifo_deliver)
+    if (!members) metric_add(metrics_local().fifoHeld, -fifo_dropRoom(fifoStreamMap, roomId));
+    if (debug_mode) debug_msg(members ? "Announced interest in room #" :
+                              "Withdrew interest in room #", roomId);
+}
+
+// a server that (again) has members in a room is new to it
+static void markFresh(int roomId, int peer) {
+    freshPeer &f = fresh[roomId][peer];
+    f.ticks = INTEREST_FRESH;
+    f.starts.clear();
+}
+
+// a refresh of an interest that had lapsed, or whose announcement we never
+// got, is as good as the announcement
+static void renew(int roomId, int peer) {
+    map<int,int> &peers = interest[roomId];
+    if (peers.find(peer) == peers.end()) markFresh(roomId, peer);
+    peers[peer] = INTEREST_LEASE;
+}
+
+static void putRooms(char *p, const int *rooms, int count) {
+    for (int i = 0; i < count; i++) {
+        uint32_t id = htonl(rooms[i]);
+        memcpy(p + 4 * i, &id, 4);
+    }
+}
+
+// refresh of several rooms, roomId is the first of them
+static void sendDigest(const int *rooms, int count) {
+    char ids[INTEREST_DIGEST * 4];
+    putRooms(ids, rooms, count);
+    wireMsg m = wire_make(WIRE_INTEREST, rooms[0], ids, 4 * count);
+    m.seq = 1;
+    m.msgId = nn;
+    forwardToServers(m);
+}
+
+// the digest arrives at the owner of its first room; the rooms of other
+// workers go on to them as digests of their own
+static void handleDigest(int peer, wireMsg const &m) {
+    static thread_local map<int, vector<int> > others; // worker -> rooms
+    for (int i = 0; i < m.len; i += 4) {
+        uint32_t id;
+        memcpy(&id, m.payload + i, 4);
+        int roomId = ntohl(id);
+        if (shard_owner(roomId) == workerId) renew(roomId, peer);
+        else others[shard_owner(roomId)].push_back(roomId);
+    }
+    map<int, vector<int> >::iterator w;
+    for (w = others.begin(); w != others.end(); w++) {
+        vector<int> &rooms = w->second;
+        if (rooms.empty()) continue;
+        int len = 4 * rooms.size();
+        msgRef pkt = msgref_alloc(WIRE_HEADER + len);
+        char *p = msgref_writable(pkt);
+        putRooms(p + WIRE_HEADER, rooms.data(), rooms.size());
+        wireMsg part = wire_make(WIRE_INTEREST, rooms[0], p + WIRE_HEADER, len);
+        part.seq = 1;
+        part.msgId = m.msgId;
+        wire_header(part, p);
+        handoffItem item = { HANDOFF_PEER, rooms[0], forwAddresses[peer], 0, std::move(pkt) };
+        shard_run(item);
+        rooms.clear();
+    }
+}
+
+// seq says if the sender (msgId, its server number) has members in the
+// room, a payload lists more rooms it has members in
+void interest_handle(wireMsg const &m) {
+    int peer = m.msgId - 1;
+    if (peer < 0 || peer >= N || peer == nn-1) {
+        if (debug_mode) debug_msg("Interest announcement from a bad server number:", m.msgId);
+        return;
+    }
+    if (m.len > 0) {
+        if (m.seq && m.len % 4 == 0) handleDigest(peer, m);
+        else if (debug_mode) debug_msg("Dropped malformed interest digest");
+        return;
+    }
+    if (m.seq) {
+        interest[m.roomId][peer] = INTEREST_LEASE;
+        markFresh(m.roomId, peer);
+        return;
+    }
+    map<int, map<int, freshPeer> >::iterator fr = fresh.find(m.roomId);
+    if (fr != fresh.end()) {
+        fr->second.erase(peer);
+        if (fr->second.empty()) fresh.erase(fr);
+    }
+    map<int, map<int,int> >::iterator it = interest.find(m.roomId);
+    if (it == interest.end()) return;
+    it->second.erase(peer);
+    if (it->second.empty()) interest.erase(it);
+}
+
+// servers with members in the room, by index
+void interest_peers(int roomId, vector<int> &out) {
+    out.clear();
+    map<int, map<int,int> >::iterator it = interest.find(roomId);
+    if (it == interest.end()) return;
+    map<int,int>::iterator p;
+    for (p = it->second.begin(); p != it->second.end(); p++) out.push_back(p->first);
+}
+
+// where sender's FIFO stream starts for a server new to the room, 0 once
+// the server is not new any more
+int interest_start(int roomId, int peer, address sender, int msgId) {
+    map<int, map<int, freshPeer> >::iterator fr = fresh.find(roomId);
+    if (fr == fresh.end()) return 0;
+    map<int, freshPeer>::iterator f = fr->second.find(peer);
+    if (f == fr->second.end()) return 0;
+    map<address,int>::iterator s = f->second.starts.find(sender);
+    if (s == f->second.starts.end()) s = f->second.starts.insert(make_pair(sender, msgId)).first;
+    return s->second;
+}
+
+// refresh our rooms, let the others' interests age
+void interest_tick() {
+    if (!interest_enabled()) return;
+    static thread_local vector<int> rooms;
+    rooms.clear();
+    map<int, chatroom>::iterator r;
+    for (r = chatrooms.begin(); r != chatrooms.end(); r++) {
+        if (!r->second.members.empty()) rooms.push_back(r->first);
+    }
+    for (int i = 0; i < rooms.size(); i += INTEREST_DIGEST) {
+        sendDigest(&rooms[i], min((int) rooms.size() - i, INTEREST_DIGEST));
+    }
+    map<int, map<int,int> >::iterator it = interest.begin();
+    while (it != interest.end()) {
+        map<int,int>::iterator p = it->second.begin();
+        while (p != it->second.end()) {
+            if (--p->second <= 0) it->second.erase(p++);
+            else p++;
+        }
+        if (it->second.empty()) interest.erase(it++);
+        else it++;
+    }
+    map<int, map<int, freshPeer> >::iterator fr = fresh.begin();
+    while (fr != fresh.end()) {
+        map<int, freshPeer>::iterator f = fr->second.begin();
+        while (f != fr->second.end()) {
+            if (--f->second.ticks <= 0) fr->second.erase(f++);
+            else f++;
+        }
+        if (fr->second.empty()) fresh.erase(fr++);
+        else fr++;
+    }
+}
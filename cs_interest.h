@@ -0,0 +1,33 @@
+#ifndef __cs_interest_h_
+#define __cs_interest_h_
+#include "cs_common.h"
+#include "cs_wire.h"
+
+// room interest: which other servers have members in a room, so unordered
+// and FIFO messages only go there (binary wire format, full mesh only).
+// the worker owning a room announces it to every server when its local
+// member count leaves zero or drops back to it. every tick each worker
+// refreshes all of its rooms with members at once: a digest listing their
+// ids, one frame per INTEREST_DIGEST rooms. an interest that is not
+// refreshed for INTEREST_LEASE ticks lapses. a lost announcement is made
+// up for by the next refresh, but the room's messages sent before it, or
+// while an interest had lapsed, never get to that server
+// a server that announces a room it had no members in, or refreshes one
+// whose interest was gone, is new to it for INTEREST_FRESH ticks: it gets
+// FIFO messages on their own, stamped with the first message number of
+// their stream it was sent, so it starts every stream there (or skips
+// ahead to it) however the first few arrive
+#define INTEREST_LEASE 3
+#define INTEREST_FRESH 2
+#define INTEREST_DIGEST ((MSG_BUFSIZE - WIRE_HEADER) / 4) // room ids per refresh
+
+extern int interest_routing;
+
+bool interest_enabled();
+void interest_changed(int roomId, bool members);
+void interest_handle(wireMsg const &m);
+void interest_peers(int roomId, vector<int> &out);
+int interest_start(int roomId, int peer, address sender, int msgId);
+void interest_tick();
+
+#endif
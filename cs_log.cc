@@ -0,0 +1,179 @@
+#include "cs_log.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+
+#define LOG_PAD 3 // filler up to the end of the ring
+
+// fixed part of a record, a string argument follows it
+struct logHeader {
+    uint32_t len; // whole record, multiple of 8
+    uint16_t kind;
+    uint16_t server;
+    struct timespec stamp;
+    const char *fmt; // string literal, its address is the format id
+    int val;
+    int strLen;
+};
+
+// single producer (the owning thread), single consumer (the writer)
+struct logRing {
+    char data[LOG_RING_BYTES];
+    std::atomic<uint64_t> head; // bytes written
+    std::atomic<uint64_t> tail; // bytes consumed
+};
+
+static std::mutex ringsLock;
+static std::vector<logRing*> rings;
+static thread_local logRing *ring = NULL;
+static std::thread writer;
+static std::once_flag started;
+static std::atomic<bool> stopping(false);
+
+static void writerLoop();
+
+static void start() {
+    writer = std::thread(writerLoop);
+    atexit(log_flush);
+}
+
+static logRing *myRing() {
+    if (ring != NULL) return ring;
+    std::call_once(started, start);
+    ring = new logRing();
+    ring->head = 0;
+    ring->tail = 0;
+    std::lock_guard<std::mutex> guard(ringsLock);
+    rings.push_back(ring);
+    return ring;
+}
+
+// appends one record, waits for the writer if the ring is full so no line is lost
+void log_record(int server, const char *fmt, int kind, int val, const char *str) {
+    logRing *r = myRing();
+    int strLen = (kind == LOG_STR) ? strlen(str) : 0;
+    if (strLen > LOG_RING_BYTES / 4) strLen = LOG_RING_BYTES / 4;
+    uint32_t len = (sizeof(logHeader) + strLen + 7) & ~7u;
+    uint64_t head = r->head.load(std::memory_order_relaxed);
+    uint64_t pos = head & (LOG_RING_BYTES - 1);
+    uint64_t pad = (LOG_RING_BYTES - pos < len) ? LOG_RING_BYTES - pos : 0;
+    while (head + pad + len - r->tail.load(std::memory_order_acquire) > LOG_RING_BYTES) {
+        sched_yield();
+    }
+    if (pad > 0) {
+        logHeader *filler = (logHeader*) (r->data + pos);
+        filler->len = pad;
+        filler->kind = LOG_PAD;
+        head += pad;
+        pos = 0;
+    }
+    logHeader *h = (logHeader*) (r->data + pos);
+    h->len = len;
+    h->kind = kind;
+    h->server = server;
+    clock_gettime(CLOCK_REALTIME, &h->stamp);
+    h->fmt = fmt;
+    h->val = val;
+    h->strLen = strLen;
+    if (strLen > 0) memcpy(h + 1, str, strLen);
+    r->head.store(head + len, std::memory_order_release);
+}
+
+// oldest unread record of the ring, NULL if there is none
+static logHeader *peek(logRing *r) {
+    uint64_t tail = r->tail.load(std::memory_order_relaxed);
+    while (tail != r->head.load(std::memory_order_acquire)) {
+        logHeader *h = (logHeader*) (r->data + (tail & (LOG_RING_BYTES - 1)));
+        if (h->kind != LOG_PAD) return h;
+        tail += h->len;
+        r->tail.store(tail, std::memory_order_release);
+    }
+    return NULL;
+}
+
+static void consume(logRing *r, logHeader *h) {
+    r->tail.store(r->tail.load(std::memory_order_relaxed) + h->len, std::memory_order_release);
+}
+
+// HH:MM:SS, localtime only runs when the second changes
+static void formatTime(time_t sec, char *out) {
+    static time_t lastSec = -1;
+    static char last[16];
+    if (sec != lastSec) {
+        struct tm timeinfo;
+        localtime_r(&sec, &timeinfo);
+        strftime(last, sizeof(last), "%R:%S", &timeinfo);
+        lastSec = sec;
+    }
+    strcpy(out, last);
+}
+
+static void print(logHeader *h) {
+    char when[16];
+    formatTime(h->stamp.tv_sec, when);
+    long usec = h->stamp.tv_nsec / 1000;
+    if (h->kind == LOG_INT) {
+        printf("%s.%06ld S%02d %s %d\n", when, usec, h->server, h->fmt, h->val);
+    } else if (h->kind == LOG_STR) {
+        printf("%s.%06ld S%02d %s %.*s\n", when, usec, h->server, h->fmt,
+               h->strLen, (const char*) (h + 1));
+    } else {
+        printf("%s.%06ld S%02d %s\n", when, usec, h->server, h->fmt);
+    }
+}
+
+static bool earlier(const struct timespec &a, const struct timespec &b) {
+    return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
+
+// prints everything queued so far, merging the threads by timestamp.
+// false if there was nothing
+static bool drain() {
+    std::vector<logRing*> all;
+    {
+        std::lock_guard<std::mutex> guard(ringsLock);
+        all = rings;
+    }
+    bool any = false;
+    while (true) {
+        logRing *best = NULL;
+        logHeader *first = NULL;
+        for (int i = 0; i < all.size(); i++) {
+            logHeader *h = peek(all[i]);
+            if (h != NULL && (first == NULL || earlier(h->stamp, first->stamp))) {
+                first = h;
+                best = all[i];
+            }
+        }
+        if (first == NULL) break;
+        print(first);
+        consume(best, first);
+        any = true;
+    }
+    if (any) fflush(stdout);
+    return any;
+}
+
+static void writerLoop() {
+    while (!stopping.load(std::memory_order_acquire)) {
+        if (!drain()) {
+            struct timespec idle = { 0, LOG_IDLE_US * 1000 };
+            nanosleep(&idle, NULL);
+        }
+    }
+    drain();
+}
+
+// writes out what is queued and stops the writer, runs at exit
+void log_flush() {
+    if (!writer.joinable()) return;
+    stopping.store(true, std::memory_order_release);
+    if (writer.get_id() == std::this_thread::get_id()) return;
+    writer.join();
+}
@@ -0,0 +1,18 @@
+#ifndef __cs_log_h_
+#define __cs_log_h_
+#include <stdint.h>
+
+// debug output without formatting or I/O on the calling thread: each
+// thread appends binary records to its own ring, a writer thread turns
+// them into "HH:MM:SS.uuuuuu Snn msg [val]" lines on stdout
+#define LOG_RING_BYTES (1 << 20) // per thread, a power of two
+#define LOG_IDLE_US 1000 // writer sleep when every ring is empty
+
+#define LOG_PLAIN 0
+#define LOG_INT 1
+#define LOG_STR 2
+
+void log_record(int server, const char *fmt, int kind, int val, const char *str);
+void log_flush();
+
+#endif
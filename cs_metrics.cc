@@ -0,0 +1,128 @@
+#include "cs_metrics.h"
+#include <mutex>
+#include <time.h>
+
+static mutex allLock;
+static vector<metrics*> all;
+static int nservers;
+static uint64_t startUs;
+static thread_local metrics *mine = NULL;
+
+static const char *cmdNames[CMD_COUNT] = { "join", "part", "nick", "quit", "message", "stats" };
+
+uint64_t metrics_nowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// once, before the workers start
+void metrics_init(int servers) {
+    nservers = servers;
+    startUs = metrics_nowUs();
+}
+
+metrics &metrics_local() {
+    if (mine != NULL) return *mine;
+    mine = new metrics();
+    mine->peerIn = new counter[nservers]();
+    mine->peerOut = new counter[nservers]();
+    lock_guard<mutex> guard(allLock);
+    all.push_back(mine);
+    return *mine;
+}
+
+void hist_record(histogram &h, long v) {
+    if (v < 0) v = 0;
+    metric_add(h.buckets[hist_bucket(v)]);
+    metric_add(h.count);
+    metric_add(h.sum, v);
+    metric_max(h.max, v);
+}
+
+static long sum(counter metrics::*field) {
+    long total = 0;
+    for (int i = 0; i < all.size(); i++) total += (all[i]->*field).load(std::memory_order_relaxed);
+    return total;
+}
+
+static long largest(counter metrics::*field) {
+    long top = 0;
+    for (int i = 0; i < all.size(); i++) top = max(top, (all[i]->*field).load(std::memory_order_relaxed));
+    return top;
+}
+
+// name count mean p50 p90 p99 p999 max, merged over the workers
+static string histLine(const char *name, histogram metrics::*field) {
+    static vector<long> merged(HIST_BUCKETS);
+    long count = 0, total = 0, top = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) merged[b] = 0;
+    for (int i = 0; i < all.size(); i++) {
+        histogram &h = all[i]->*field;
+        for (int b = 0; b < HIST_BUCKETS; b++) merged[b] += h.buckets[b].load(std::memory_order_relaxed);
+        count += h.count.load(std::memory_order_relaxed);
+        total += h.sum.load(std::memory_order_relaxed);
+        top = max(top, h.max.load(std::memory_order_relaxed));
+    }
+    string out = string(name) + " count " + to_string(count) +
+                 " mean " + to_string(count > 0 ? total / count : 0);
+    const char *labels[] = { "p50", "p90", "p99", "p999" };
+    const double quantiles[] = { 0.50, 0.90, 0.99, 0.999 };
+    for (int q = 0; q < 4; q++) {
+        long want = (long) (quantiles[q] * count + 0.999999), seen = 0;
+        uint64_t value = 0;
+        for (int b = 0; b < HIST_BUCKETS && count > 0; b++) {
+            seen += merged[b];
+            if (seen >= want) {
+                value = min((uint64_t) top, hist_bucketTop(b));
+                break;
+            }
+        }
+        out += string(" ") + labels[q] + " " + to_string(value);
+    }
+    return out + " max " + to_string(top) + "\n";
+}
+
+// the /stats reply, "name value..." per line
+string metrics_report() {
+    lock_guard<mutex> guard(allLock);
+    string out = "+OK stats\n";
+    out += "uptime_s " + to_string((metrics_nowUs() - startUs) / 1000000) + "\n";
+    out += "workers " + to_string(all.size()) + "\n";
+    out += "clients " + to_string(sum(&metrics::clients)) + "\n";
+    out += "clients_evicted " + to_string(sum(&metrics::evicted)) + "\n";
+    out += "client_in " + to_string(sum(&metrics::clientIn)) + "\n";
+    out += "client_out " + to_string(sum(&metrics::clientOut)) + "\n";
+    for (int c = 0; c < CMD_COUNT; c++) {
+        long n = 0;
+        for (int i = 0; i < all.size(); i++) n += all[i]->commands[c].load(std::memory_order_relaxed);
+        out += string("cmd_") + cmdNames[c] + " " + to_string(n) + "\n";
+    }
+    for (int p = 0; p < nservers; p++) {
+        long in = 0, sent = 0;
+        for (int i = 0; i < all.size(); i++) {
+            in += all[i]->peerIn[p].load(std::memory_order_relaxed);
+            sent += all[i]->peerOut[p].load(std::memory_order_relaxed);
+        }
+        out += "peer " + to_string(p + 1) + " in " + to_string(in) + " out " + to_string(sent) + "\n";
+    }
+    out += "send_errors " + to_string(sum(&metrics::sendErrors)) + "\n";
+    out += "send_queue queued " + to_string(sum(&metrics::sendQueued)) + " dropped " +
+           to_string(sum(&metrics::sendDropped)) + " depth " + to_string(sum(&metrics::sendQueue)) +
+           " max " + to_string(largest(&metrics::sendQueueMax)) + "\n";
+    out += "client_shed " + to_string(sum(&metrics::clientShed)) + "\n";
+    long coalesced = sum(&metrics::coalesced), bundles = sum(&metrics::bundles);
+    char ratio[32];
+    snprintf(ratio, sizeof(ratio), "%.2f", bundles > 0 ? (double) coalesced / bundles : 0.0);
+    out += "coalesce messages " + to_string(coalesced) + " datagrams " + to_string(bundles) +
+           " ratio " + ratio + "\n";
+    out += "fifo_held " + to_string(sum(&metrics::fifoHeld)) +
+           " max " + to_string(largest(&metrics::fifoHeldMax)) +
+           " skipped " + to_string(sum(&metrics::fifoSkipped)) + "\n";
+    out += "total_held " + to_string(sum(&metrics::totalHeld)) +
+           " max " + to_string(largest(&metrics::totalHeldMax)) + "\n";
+    out += histLine("fanout_size", &metrics::fanout);
+    out += histLine("total_round_us", &metrics::roundUs);
+    out += histLine("holdback_us", &metrics::holdbackUs);
+    return out;
+}
@@ -0,0 +1,80 @@
+#ifndef __cs_metrics_h_
+#define __cs_metrics_h_
+#include "cs_common.h"
+#include <atomic>
+
+// counters and histograms, one set per worker. only the owning worker
+// writes them (a relaxed load and store, no locked instruction), /stats
+// reads and sums every worker's set
+#define HIST_SUB_BITS 4 // 16 linear buckets per power of two, ~6% error
+#define HIST_BUCKETS (64 << HIST_SUB_BITS)
+
+#define CMD_JOIN 0
+#define CMD_PART 1
+#define CMD_NICK 2
+#define CMD_QUIT 3
+#define CMD_MESSAGE 4
+#define CMD_STATS 5
+#define CMD_COUNT 6
+
+typedef std::atomic<long> counter;
+
+// log-linear buckets in the style of HdrHistogram
+struct histogram {
+    counter buckets[HIST_BUCKETS];
+    counter count;
+    counter sum;
+    counter max;
+};
+
+struct metrics {
+    counter clientIn, clientOut; // datagrams from and to clients
+    counter *peerIn, *peerOut;   // datagrams per server, by index
+    counter commands[CMD_COUNT];
+    counter sendErrors;
+    counter sendQueued, sendDropped; // datagrams that waited for the socket, dropped from a full queue
+    counter sendQueue, sendQueueMax; // datagrams waiting now
+    counter clientShed; // chat lines over their client's rate
+    counter coalesced, bundles; // server messages coalesced, datagrams they went out in
+    counter clients; // connected to this worker
+    counter evicted; // clients removed for being idle
+    counter fifoHeld, fifoHeldMax; // messages waiting in FIFO reorder windows
+    counter fifoSkipped; // FIFO messages given up on to keep a stream moving
+    counter totalHeld, totalHeldMax; // messages in total order holdback queues
+    histogram fanout; // clients per local delivery
+    histogram roundUs; // total order: initial sent -> final sent
+    histogram holdbackUs; // total order: time in the holdback queue
+};
+
+inline void metric_add(counter &c, long n = 1) {
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline void metric_max(counter &c, long v) {
+    if (v > c.load(std::memory_order_relaxed)) c.store(v, std::memory_order_relaxed);
+}
+
+// values below 2^HIST_SUB_BITS get a bucket each, above that every power
+// of two is split into 2^HIST_SUB_BITS equal buckets
+inline int hist_bucket(uint64_t v) {
+    if (v < (1 << HIST_SUB_BITS)) return v;
+    int exp = 63 - __builtin_clzll(v);
+    int shift = exp - HIST_SUB_BITS;
+    return ((shift + 1) << HIST_SUB_BITS) + (int) ((v >> shift) & ((1 << HIST_SUB_BITS) - 1));
+}
+
+// largest value that falls into bucket b
+inline uint64_t hist_bucketTop(int b) {
+    if (b < (1 << HIST_SUB_BITS)) return b;
+    int shift = (b >> HIST_SUB_BITS) - 1;
+    uint64_t sub = b & ((1 << HIST_SUB_BITS) - 1);
+    return (((1ULL << HIST_SUB_BITS) + sub + 1) << shift) - 1;
+}
+
+void metrics_init(int servers);
+metrics &metrics_local();
+void hist_record(histogram &h, long v);
+uint64_t metrics_nowUs();
+string metrics_report();
+
+#endif
@@ -0,0 +1,171 @@
+#include "cs_msgbuf.h"
+#include <mutex>
+#include <new>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// free buffers: a per-thread list for each class, and a shared one that
+// takes the surplus of threads that free more than they allocate
+struct freeList {
+    msgBuf *head;
+    int count;
+};
+
+static const int classSize[2] = { MSGBUF_SMALL, MSGBUF_LARGE };
+static thread_local freeList local[2];
+static freeList shared[2];
+static std::mutex sharedLock;
+msgPoolStats mstats;
+
+char *msgbuf_bytes(msgBuf *b) {
+    return (char*) (b + 1);
+}
+
+// buffers are never handed back to the heap, a chunk lives as long as the server
+static void carve(int cls) {
+    size_t size = sizeof(msgBuf) + classSize[cls];
+    char *chunk = (char*) malloc(size * MSGBUF_CHUNK);
+    if (chunk == NULL) abort();
+    for (int i = 0; i < MSGBUF_CHUNK; i++) {
+        msgBuf *b = new (chunk + i * size) msgBuf();
+        b->cls = cls;
+        b->cap = classSize[cls];
+        b->next = local[cls].head;
+        local[cls].head = b;
+    }
+    local[cls].count += MSGBUF_CHUNK;
+    __atomic_add_fetch(&mstats.chunks, 1, __ATOMIC_RELAXED);
+}
+
+static msgBuf *get(int cls) {
+    freeList &l = local[cls];
+    if (l.head == NULL) {
+        std::lock_guard<std::mutex> guard(sharedLock);
+        if (shared[cls].head != NULL) {
+            l = shared[cls];
+            shared[cls].head = NULL;
+            shared[cls].count = 0;
+        }
+    }
+    if (l.head == NULL) carve(cls);
+    msgBuf *b = l.head;
+    l.head = b->next;
+    l.count--;
+    b->refs.store(1, std::memory_order_relaxed);
+    return b;
+}
+
+static void put(msgBuf *b) {
+    freeList &l = local[b->cls];
+    b->next = l.head;
+    l.head = b;
+    if (++l.count <= MSGBUF_CACHE) return;
+    // hand half of the list to the threads that run dry
+    msgBuf *last = l.head;
+    for (int i = 1; i < MSGBUF_CACHE / 2; i++) last = last->next;
+    std::lock_guard<std::mutex> guard(sharedLock);
+    freeList &s = shared[b->cls];
+    msgBuf *rest = last->next;
+    last->next = s.head;
+    s.head = l.head;
+    s.count += MSGBUF_CACHE / 2;
+    l.head = rest;
+    l.count -= MSGBUF_CACHE / 2;
+    mstats.shared += MSGBUF_CACHE / 2;
+}
+
+static void unref(msgBuf *b) {
+    if (b != NULL && b->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) put(b);
+}
+
+msgRef::msgRef(const msgRef &o) : buf(o.buf), off(o.off), len(o.len) {
+    if (buf != NULL) buf->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+msgRef::msgRef(msgRef &&o) : buf(o.buf), off(o.off), len(o.len) {
+    o.buf = NULL;
+    o.len = 0;
+}
+
+msgRef &msgRef::operator = (const msgRef &o) {
+    if (o.buf != NULL) o.buf->refs.fetch_add(1, std::memory_order_relaxed);
+    unref(buf);
+    buf = o.buf;
+    off = o.off;
+    len = o.len;
+    return *this;
+}
+
+msgRef &msgRef::operator = (msgRef &&o) {
+    if (this == &o) return *this;
+    unref(buf);
+    buf = o.buf;
+    off = o.off;
+    len = o.len;
+    o.buf = NULL;
+    o.len = 0;
+    return *this;
+}
+
+msgRef::~msgRef() {
+    unref(buf);
+}
+
+const char *msgRef::data() const {
+    return buf == NULL ? "" : msgbuf_bytes(buf) + off;
+}
+
+// an unshared buffer for len bytes, headroom in front of them
+msgRef msgref_alloc(int len) {
+    msgRef r;
+    r.buf = get(MSGBUF_HEADROOM + len + 1 <= MSGBUF_SMALL ? 0 : 1);
+    assert(MSGBUF_HEADROOM + len + 1 <= r.buf->cap);
+    r.off = MSGBUF_HEADROOM;
+    r.len = len;
+    return r;
+}
+
+msgRef msgref_copy(const char *p, int len) {
+    msgRef r = msgref_alloc(len);
+    memcpy(msgref_writable(r), p, len);
+    return r;
+}
+
+// another reference to bytes that already live in b
+msgRef msgref_view(msgBuf *b, const char *p, int len) {
+    msgRef r;
+    if (b == NULL) return msgref_copy(p, len);
+    b->refs.fetch_add(1, std::memory_order_relaxed);
+    r.buf = b;
+    r.off = p - msgbuf_bytes(b);
+    r.len = len;
+    return r;
+}
+
+bool msgref_shared(msgRef const &r) {
+    return r.buf != NULL && r.buf->refs.load(std::memory_order_acquire) > 1;
+}
+
+// the bytes may only change while nobody else holds the buffer
+char *msgref_writable(msgRef &r) {
+    assert(!msgref_shared(r));
+    return msgbuf_bytes(r.buf) + r.off;
+}
+
+// grows the message by n bytes at the front, NULL if the headroom is too small
+char *msgref_prepend(msgRef &r, int n) {
+    if (msgref_headroom(r) < n || msgref_shared(r)) return NULL;
+    r.off -= n;
+    r.len += n;
+    return msgbuf_bytes(r.buf) + r.off;
+}
+
+int msgref_headroom(msgRef const &r) {
+    return r.buf == NULL ? 0 : r.off;
+}
+
+// for debug output
+std::string msgref_str(msgRef const &r) {
+    return std::string(r.data(), r.len);
+}
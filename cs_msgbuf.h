@@ -0,0 +1,60 @@
+#ifndef __cs_msgbuf_h_
+#define __cs_msgbuf_h_
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+// refcounted message buffers. a datagram is received into one, and every
+// queue or handoff after that holds a msgRef into it instead of a copy.
+// the bytes in front of the message are headroom: the nick prefix and wire
+// headers are written there, right before the bytes go out
+#define MSGBUF_HEADROOM 128
+#define MSGBUF_SMALL 2048 // class for messages that fit one frame
+#define MSGBUF_MAXLEN 65535 // longest message, the wire limits follow from it
+#define MSGBUF_LARGE (MSGBUF_HEADROOM + MSGBUF_MAXLEN + 1) // class for anything up to MSGBUF_MAXLEN
+#define MSGBUF_CACHE 256 // free buffers per class a thread keeps for itself
+#define MSGBUF_CHUNK 32  // buffers taken from the heap at once
+
+struct msgBuf {
+    std::atomic<int> refs; // refs move between workers with handoffs
+    int cls; // size class
+    int cap; // bytes after the header
+    msgBuf *next; // free list
+};
+
+// counted view of len bytes at data + off of a buffer
+struct msgRef {
+    msgBuf *buf;
+    int off;
+    int len;
+
+    msgRef() : buf(NULL), off(0), len(0) {}
+    msgRef(const msgRef &o);
+    msgRef(msgRef &&o);
+    msgRef &operator = (const msgRef &o);
+    msgRef &operator = (msgRef &&o);
+    ~msgRef();
+
+    const char *data() const;
+    int size() const { return len; }
+    bool empty() const { return len == 0; }
+};
+
+struct msgPoolStats {
+    long chunks; // heap allocations for new buffers
+    long shared; // buffers moved through the shared free list
+};
+
+extern msgPoolStats mstats;
+
+char *msgbuf_bytes(msgBuf *b);
+msgRef msgref_alloc(int len);
+msgRef msgref_copy(const char *p, int len);
+msgRef msgref_view(msgBuf *b, const char *p, int len);
+bool msgref_shared(msgRef const &r);
+char *msgref_writable(msgRef &r);
+char *msgref_prepend(msgRef &r, int n);
+int msgref_headroom(msgRef const &r);
+std::string msgref_str(msgRef const &r);
+
+#endif
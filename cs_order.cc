@@ -0,0 +1,525 @@
+#include "cs_order.h"
+#include "cs_fanout.h"
+#include "cs_index.h"
+#include "cs_room.h"
+#include "cs_holdback.h"
+#include "cs_fifo.h"
+#include "cs_metrics.h"
+#include "cs_coalesce.h"
+#include "cs_relay.h"
+#include "cs_interest.h"
+#include "cs_group.h"
+
+int order_mode = 0;
+int total_window = 1; // total ordering rounds in flight per room and sender
+int total_batch = 1; // queued messages packed into one ordering round
+address selfAddr;
+thread_local fragPool reassembly; // fragmented server messages being put back together
+
+// fifo ordering data
+thread_local unordered_map<fifoKey, fifoStream, fifoKeyHash> fifoStreamMap;
+
+// total ordering data
+thread_local map<int, total_s> totalSenderMap; // chatroom to info
+thread_local map<int, total_r> totalReceiverMap; // chatroom to info
+
+// sequencer ordering data
+thread_local map<int, int> seqCounterMap; // chatroom to last number handed out
+thread_local map<int, seq_r> seqReceiverMap; // chatroom to info
+
+static void relayForward(wireMsg const &m);
+static void sendToPeers(vector<int> const &peers, wireMsg const &m);
+
+void handlePeer(address sender, wireMsg const &m) {
+    if (m.type == WIRE_FRAGMENT) {
+        msgRef buf;
+        if (!frag_add(reassembly, sender, m, buf)) return;
+        wireMsg whole;
+        if (wire_parse(buf.data(), buf.size(), plainWireType(), whole) &&
+            whole.type != WIRE_FRAGMENT && whole.roomId == m.roomId) {
+            whole.owner = buf.buf;
+            handlePeer(sender, whole);
+        } else if (debug_mode) {
+            debug_msg("Dropped malformed reassembled message");
+        }
+    } else if (m.type == WIRE_UNORDERED) {
+        if (m.flags & WIRE_FLAG_RELAY) relayForward(m);
+        unordered_deliver(m);
+    } else if (m.type == WIRE_FIFO) {
+        if (m.flags & WIRE_FLAG_RELAY) relayForward(m);
+        fifo_deliver(m);
+    } else if (m.type == WIRE_SEQ_REQUEST || m.type == WIRE_SEQ_ORDER) {
+        seq_handle(sender, m);
+    } else if (m.type == WIRE_INTEREST) {
+        interest_handle(m);
+    } else if (m.type == WIRE_GROUP) {
+        group_handle(sender, m);
+    } else {
+        total_handle(sender, m);
+    }
+}
+
+// how a text-format message that only carries a room id is read
+int plainWireType() {
+    if (order_mode == 1) return WIRE_FIFO;
+    if (order_mode == 2) return WIRE_INITIAL;
+    return WIRE_UNORDERED;
+}
+
+// order and deliver a chat line from one of our clients, on the room's worker
+void room_publish(int roomId, int count, address client, msgRef const &msg) {
+    if (order_mode == 0) {  // unordered
+        b_deliver(roomId, msg);
+        forwardToServers(wire_makeRef(WIRE_UNORDERED, roomId, msg));
+    } else if (order_mode == 1) { // fifo ordering
+        b_deliver(roomId, msg);
+        wireMsg m = wire_makeRef(WIRE_FIFO, roomId, msg);
+        m.seq = count;
+        m.origin = client;
+        forwardToServers(m);
+    } else if (order_mode == 2) { // total ordering
+        totalSenderMap[roomId].msgQueue.push(msg);
+        total_sendInitial(roomId);
+    } else if (order_mode == 3) { // sequencer ordering
+        int seqServer = seq_server(roomId);
+        if (seqServer == nn-1) {
+            seq_assign(roomId, msg);
+        } else {
+            sendToServer(forwAddresses[seqServer], wire_makeRef(WIRE_SEQ_REQUEST, roomId, msg));
+        }
+    }
+}
+
+// deliver whatever the next message was holding up
+static void fifo_drain(int roomId, fifoStream &fq) {
+    while (fifo_ready(fq)) {
+        b_deliver(roomId, fifo_front(fq));
+        fifo_advance(fq);
+        metric_add(metrics_local().fifoHeld, -1);
+        if (debug_mode) debug_msg("Popped and delivered from window MSG #", fq.lastMsgId); 
+    }
+}
+
+// Message carries <msgId>, the client it came from and <roomId>
+void fifo_deliver(wireMsg const &m) {
+    int msgId = m.seq;
+    int roomId = m.roomId;
+    if (msgId <= 0) {
+        if (debug_mode) debug_msg("Dropped FIFO MSG with a bad number #", msgId);
+        return;
+    }
+    fifoKey key = fifo_key(m.origin, roomId);
+    if (interest_enabled()) {
+        // streams only run while the room has members here; a new one starts
+        // where the sender's server stamped it, or at whatever arrives first
+        // if none of the stamped messages made it. a stamp ahead of a stream
+        // we have means its server had lost our interest for a while: what
+        // it held back then is not coming
+        if (room_find(roomId) == NULL) return;
+        if (fifoStreamMap.find(key) == fifoStreamMap.end()) {
+            fifoStreamMap[key].lastMsgId = (m.stamp > 0 ? m.stamp : msgId) - 1;
+        }
+    }
+    fifoStream &fq = fifoStreamMap[key];
+    int upTo = msgId - FIFO_WINDOW; // too far ahead to wait for the gap any longer
+    if (interest_enabled() && m.stamp > 0) upTo = max(upTo, m.stamp - 1);
+    if (upTo > fq.lastMsgId) {
+        int skipped = 0;
+        while (upTo > fq.lastMsgId) {
+            skipped += fifo_resync(fq, upTo);
+            fifo_drain(roomId, fq);
+        }
+        metric_add(metrics_local().fifoSkipped, skipped);
+        if (debug_mode) debug_msg("Gave up on missing MSGs, skipped:", skipped);
+    }
+    int r = fq.lastMsgId;
+    if (msgId == (r+1)) {
+        b_deliver(roomId, m.payload, m.len);
+        fifo_advance(fq);
+        if (debug_mode) debug_msg("Received and delivered MSG #", msgId); 
+        
+        fifo_drain(roomId, fq);
+        if (debug_mode && fq.buffered > 0) debug_msg("Need earlier MSG to arrive, held:", fq.buffered);
+    } else if (msgId > (r+1)) {
+        if (fifo_hold(fq, msgId, wire_payload(m))) {
+            metrics &mt = metrics_local();
+            metric_add(mt.fifoHeld);
+            metric_max(mt.fifoHeldMax, mt.fifoHeld.load(memory_order_relaxed));
+            if (debug_mode) debug_msg("Pushed to window MSG #", msgId);
+        } else {
+            if (debug_mode) debug_msg("MSG already held #", msgId);
+        }
+    } 
+    else {
+        if (debug_mode) debug_msg("MSG received has been delivered");
+    }
+}
+
+// start ordering rounds for queued messages until the window is full
+void total_sendInitial(int roomId) {
+    total_s &sInfo = totalSenderMap[roomId];
+    while (sInfo.inflight.size() < total_window && !sInfo.msgQueue.empty() &&
+           group_ready(roomId)) {
+        int msgId = ++sInfo.nextId;
+        total_round &round = sInfo.inflight[msgId];
+        round.batched = total_batch > 1;
+        if (round.batched) {
+            // everything that is waiting, as far as one datagram allows
+            int count = 0, used = 0;
+            round.msg = msgref_alloc(max(TOTAL_BATCH_BYTES, 2 + sInfo.msgQueue.front().size()));
+            char *p = msgref_writable(round.msg);
+            while (count < total_batch && !sInfo.msgQueue.empty()) {
+                msgRef &next = sInfo.msgQueue.front();
+                if (count > 0 && used + 2 + next.size() > TOTAL_BATCH_BYTES) break;
+                used += wire_batchAppend(p + used, next.data(), next.size());
+                sInfo.msgQueue.pop();
+                count++;
+            }
+            round.msg.len = used;
+            if (debug_mode && count > 1) debug_msg("Batched messages into one round:", count);
+        } else {
+            round.msg = std::move(sInfo.msgQueue.front());
+            sInfo.msgQueue.pop();
+        }
+        // update own receiverMap as well
+        total_r &rInfo = totalReceiverMap[roomId];
+        rInfo.P = max(rInfo.P, rInfo.A) + 1;
+        round.startUs = metrics_nowUs();
+        totalMsg foo = {rInfo.P, selfAddr, round.msg, false, msgId, round.batched, round.startUs};
+        total_holdback(rInfo.queue, foo);
+
+        round.T = rInfo.P;
+        round.responses[selfAddr] = rInfo.P;
+        round.need = N;
+        // forward initial msg to other servers, or to the room's group
+        wireMsg m = wire_makeRef(WIRE_INITIAL, roomId, round.msg);
+        m.msgId = msgId;
+        if (round.batched) m.flags = WIRE_FLAG_BATCH;
+        if (group_enabled()) {
+            group_peers(roomId, round.peers);
+            round.need = round.peers.size() + 1;
+            if (!round.peers.empty()) sendToPeers(round.peers, m);
+        } else {
+            forwardToServers(m);
+        }
+        if (round.responses.size() == round.need) total_sendFinal(roomId, msgId);
+    }
+}
+
+void total_sendFinal(int roomId, int msgId) {
+    // after sending final msg, the window has room for the next msg in line
+    total_s &currInfo = totalSenderMap[roomId];
+    total_round &round = currInfo.inflight[msgId];
+    map<address,int> &res = round.responses;
+    map<address, int>::iterator it;
+    wireMsg m = wire_makeRef(WIRE_FINAL, roomId, round.msg);
+    m.stamp = round.T;
+    if (round.batched) m.flags = WIRE_FLAG_BATCH;
+    for (it = res.begin(); it != res.end(); it++) {
+        if (it->first == selfAddr) {
+            total_updateReceiverQueue(roomId, round.T, it->second);
+            continue;
+        }
+        if (round.join) continue; // only held here
+        m.seq = it->second;
+        sendToServer(it->first, m);
+    }
+    if (!round.join) hist_record(metrics_local().roundUs, metrics_nowUs() - round.startUs);
+    if (debug_mode && round.batched) debug_msg("Sent out final message for batch #", msgId);
+    else if (debug_mode) debug_msg("Sent out final message:", msgref_str(round.msg).c_str());
+    currInfo.inflight.erase(msgId);
+    group_roundDone(roomId, msgId);
+    // move on to process the next unsent message in queue
+    if (!currInfo.msgQueue.empty())  total_sendInitial(roomId);
+}
+
+void total_updateReceiverQueue(int roomId, int T, int oldP) {
+    total_r &currInfo = totalReceiverMap[roomId];
+    holdbackQueue &queue = currInfo.queue;
+    currInfo.A = max(currInfo.A, T);
+    if (oldP <= T) {
+        // update queue
+        // find totalMsg with oldP as timestamp and update
+        if (holdback_finalize(queue, oldP, T)) {
+            // printHoldbackQueue(queue);
+            if (debug_mode) {
+                debug_msg("Reordered holdback queue for chatroom #", roomId);
+            }
+        }
+    } else {
+        if (debug_mode) debug_msg("ERROR! This shouldn't happen!");
+    }
+    while (!holdback_empty(queue)) {
+        if (holdback_front(queue).deliverable) {
+            totalMsg &front = holdback_front(queue);
+            total_deliver(roomId, front);
+            if (debug_mode) debug_msg("Delivered front of holdback queue:", 
+                                    msgref_str(front.msg).c_str());
+            metrics &mt = metrics_local();
+            hist_record(mt.holdbackUs, metrics_nowUs() - front.queuedUs);
+            metric_add(mt.totalHeld, -1);
+            holdback_pop(queue);
+        } else {
+            if (debug_mode) debug_msg("First message in holdback queue not yet deliverable");
+            break;
+        }
+    }
+}
+
+void total_handle(struct address sender, wireMsg const &m) {
+    int roomId = m.roomId;
+    // sender receiving proposal from receivers
+    if (m.type == WIRE_PROPOSAL) {
+        if (debug_mode) debug_msg("Got proposal: ", m.seq);
+        int P = m.seq;
+        total_s &currInfo = totalSenderMap[roomId];
+        map<int,total_round>::iterator rt = currInfo.inflight.find(m.msgId);
+        // text format proposals carry no id, the window is 1 then
+        if (m.msgId == 0 && !currInfo.inflight.empty()) rt = currInfo.inflight.begin();
+        if (rt == currInfo.inflight.end()) {
+            if (debug_mode) debug_msg("Proposal for unknown message", m.msgId);
+            return;
+        }
+        map<address,int> &currResponses = rt->second.responses;
+        if (currResponses.find(sender) == currResponses.end()) {
+            currResponses[sender] = P;
+            rt->second.T = max(rt->second.T, P);
+            if (rt->second.join) group_learn(roomId, sender, m.stamp);
+            // send out final timestamp 
+            if (currResponses.size() == rt->second.need) total_sendFinal(roomId, rt->first); 
+        } else {
+            if (debug_mode) debug_msg("This server already proposed");
+        }
+    } 
+    // receivers receiving final timestamp from sender
+    else if (m.type == WIRE_FINAL) {
+        if (debug_mode) debug_msg("Got final message: ", string(m.payload, m.len).c_str());
+        total_updateReceiverQueue(roomId, m.stamp, m.seq);
+    } 
+    // receivers receiving initial message from sender
+    else if (m.type == WIRE_INITIAL) { 
+        msgRef text = wire_payload(m);
+        if (debug_mode) debug_msg("Got initial message: ", msgref_str(text).c_str());
+        total_r &currInfo = totalReceiverMap[roomId];
+
+        // send proposal message back to sender
+        currInfo.P = max(currInfo.P, currInfo.A) + 1;
+        wireMsg proposal = wire_make(WIRE_PROPOSAL, roomId, NULL, 0);
+        proposal.seq = currInfo.P;
+        proposal.msgId = m.msgId;
+        sendToServer(sender, proposal);
+        if (debug_mode) debug_msg("Proposed ", currInfo.P);
+        totalMsg tm = { currInfo.P, sender, text, false, m.msgId,
+                        (m.flags & WIRE_FLAG_BATCH) != 0, metrics_nowUs() };
+        total_holdback(currInfo.queue, tm);
+    }
+}
+
+void total_holdback(holdbackQueue &queue, totalMsg const &m) {
+    holdback_push(queue, m);
+    metrics &mt = metrics_local();
+    metric_add(mt.totalHeld);
+    metric_max(mt.totalHeldMax, mt.totalHeld.load(memory_order_relaxed));
+}
+
+// a batch takes one slot in the holdback queue, its lines go out in order
+void total_deliver(int roomId, totalMsg const &m) {
+    if (!group_deliver(roomId, m)) return;
+    if (!m.batched) {
+        b_deliver(roomId, m.msg);
+        return;
+    }
+    const char *p = m.msg.data(), *end = p + m.msg.size();
+    const char *line;
+    int len;
+    while (wire_batchNext(p, end, line, len)) b_deliver(roomId, line, len);
+}
+
+// index of the server that numbers the messages of a room
+int seq_server(int roomId) {
+    return ((unsigned) roomId) % N;
+}
+
+// on the room's sequencer: number the message, send it to everyone else
+// and deliver it here. numbers are handed out in delivery order, so the
+// sequencer itself never needs the gap buffer
+void seq_assign(int roomId, msgRef const &msg) {
+    int seq = ++seqCounterMap[roomId];
+    wireMsg m = wire_makeRef(WIRE_SEQ_ORDER, roomId, msg);
+    m.seq = seq;
+    forwardToServers(m);
+    seqReceiverMap[roomId].next = seq;
+    b_deliver(roomId, msg);
+    if (debug_mode) debug_msg("Sequenced and delivered MSG #", seq);
+}
+
+void seq_handle(struct address sender, wireMsg const &m) {
+    int roomId = m.roomId;
+    if (m.type == WIRE_SEQ_REQUEST) {
+        if (seq_server(roomId) != nn-1) {
+            if (debug_mode) debug_msg("Not the sequencer of chat room #", roomId);
+            return;
+        }
+        seq_assign(roomId, wire_payload(m));
+        return;
+    }
+    // numbered message from the sequencer, deliver in sequence order
+    seq_r &sInfo = seqReceiverMap[roomId];
+    if (m.seq == sInfo.next + 1) {
+        b_deliver(roomId, m.payload, m.len);
+        sInfo.next++;
+        if (debug_mode) debug_msg("Received and delivered sequenced MSG #", m.seq);
+        map<int, msgRef>::iterator it = sInfo.gap.begin();
+        while (it != sInfo.gap.end() && it->first == sInfo.next + 1) {
+            b_deliver(roomId, it->second);
+            sInfo.next++;
+            if (debug_mode) debug_msg("Delivered sequenced MSG # from gap buffer", it->first);
+            sInfo.gap.erase(it++);
+        }
+    } else if (m.seq > sInfo.next + 1) {
+        sInfo.gap[m.seq] = wire_payload(m);
+        if (debug_mode) debug_msg("Buffered sequenced MSG #", m.seq);
+    } else {
+        if (debug_mode) debug_msg("Sequenced MSG has been delivered", m.seq);
+    }
+}
+
+// forward to all clients in the chat room 
+void unordered_deliver(wireMsg const &m) {
+    b_deliver(m.roomId, m.payload, m.len);
+}
+
+// basic local deliver primitive
+void b_deliver(int roomId, const char *msg, int len) {
+    chatroom *room = room_find(roomId);
+    if (room == NULL) return;
+    int sent = fanout_send(sockfd, room->dests.data(), room->dests.size(), msg, len);
+    metrics &mt = metrics_local();
+    metric_add(mt.clientOut, sent);
+    hist_record(mt.fanout, room->dests.size());
+}
+
+void b_deliver(int roomId, msgRef const &msg) {
+    b_deliver(roomId, msg.data(), msg.size());
+}
+
+// header in front of the payload where it lies, or both copied into a
+// scratch buffer for messages that are not in a msgBuf of their own
+static int encodeForSend(wireMsg const &m, char *&out) {
+    static thread_local char buf[WIRE_MAXSIZE];
+    int len = wire_encodeFront(m, out);
+    if (len >= 0) return len;
+    out = buf;
+    return wire_encode(m, out, WIRE_MAXSIZE);
+}
+
+// one message to some of the other servers, by index
+static void sendToPeers(vector<int> const &peers, wireMsg const &m) {
+    char *out;
+    int len = encodeForSend(m, out);
+    if (len < 0) {
+        if (debug_mode) debug_msg("Message too large to forward");
+        return;
+    }
+    if (coalesce_fits(len)) {
+        for (int i = 0; i < peers.size(); i++) coalesce_add(peers[i], out, len);
+        return;
+    }
+    static thread_local vector<struct sockaddr_in> dests;
+    dests.clear();
+    for (int i = 0; i < peers.size(); i++) {
+        coalesce_flush(peers[i]);
+        dests.push_back(toSockaddr(forwAddresses[peers[i]]));
+    }
+    int pieces = frag_send(sockfd, dests.data(), dests.size(), m.roomId, out, len);
+    metrics &mt = metrics_local();
+    for (int i = 0; i < peers.size(); i++) metric_add(mt.peerOut[peers[i]], pieces);
+}
+
+// pass a relayed message on to our children in its origin's tree
+static void relayForward(wireMsg const &m) {
+    static thread_local vector<int> children;
+    int origin = m.msgId - 1;
+    if (origin < 0 || origin >= N || origin == nn-1) {
+        if (debug_mode) debug_msg("Relayed message with a bad origin:", m.msgId);
+        return;
+    }
+    relay_children(origin, nn-1, children);
+    if (!children.empty()) sendToPeers(children, m);
+}
+
+// forward msg to all other servers except self, or to the first hops of
+// our relay tree
+void forwardToServers(wireMsg const &m) {
+    if (debug_mode) debug_msg("Forwarding to other servers:", string(m.payload, m.len).c_str());
+    if (peerDests.empty()) return;
+    static thread_local vector<int> targets;
+    if (relay_enabled(m.type)) {
+        wireMsg r = m;
+        r.flags |= WIRE_FLAG_RELAY;
+        r.msgId = nn;
+        relay_children(nn-1, nn-1, targets);
+        sendToPeers(targets, r);
+        return;
+    }
+    if (interest_enabled() && (m.type == WIRE_UNORDERED || m.type == WIRE_FIFO)) {
+        interest_peers(m.roomId, targets);
+        if (m.type == WIRE_FIFO) {
+            // servers new to the room get their own copy, stamped
+            static thread_local vector<int> one(1);
+            int k = 0;
+            for (int i = 0; i < targets.size(); i++) {
+                int start = interest_start(m.roomId, targets[i], m.origin, m.seq);
+                if (start == 0) {
+                    targets[k++] = targets[i];
+                    continue;
+                }
+                wireMsg s = m;
+                s.stamp = start;
+                one[0] = targets[i];
+                sendToPeers(one, s);
+            }
+            targets.resize(k);
+        }
+        if (!targets.empty()) sendToPeers(targets, m);
+        return;
+    }
+    char *out;
+    int len = encodeForSend(m, out);
+    if (len < 0) {
+        if (debug_mode) debug_msg("Message too large to forward");
+        return;
+    }
+    if (coalesce_fits(len)) {
+        for (int i = 0; i < N; i++) {
+            if (i != nn-1) coalesce_add(i, out, len);
+        }
+        return;
+    }
+    coalesce_flushAll(); // what is queued goes first
+    int pieces = frag_send(sockfd, peerDests.data(), peerDests.size(), m.roomId, out, len);
+    metrics &mt = metrics_local();
+    for (int i = 0; i < N; i++) {
+        if (i != nn-1) metric_add(mt.peerOut[i], pieces);
+    }
+}
+
+void sendToServer(address server, wireMsg const &m) {
+    char *out;
+    int len = encodeForSend(m, out);
+    if (len < 0) {
+        if (debug_mode) debug_msg("Message too large to send");
+        return;
+    }
+    indexEntry *e = index_find(endpoints, server);
+    if (e != NULL && e->kind == INDEX_PEER) {
+        if (coalesce_fits(len)) {
+            coalesce_add(e->peer, out, len);
+            return;
+        }
+        coalesce_flush(e->peer);
+    }
+    struct sockaddr_in dest = toSockaddr(server);
+    int pieces = frag_send(sockfd, &dest, 1, m.roomId, out, len);
+    if (e != NULL && e->kind == INDEX_PEER) metric_add(metrics_local().peerOut[e->peer], pieces);
+}
@@ -0,0 +1,44 @@
+#ifndef __cs_order_h_
+#define __cs_order_h_
+#include "cs_common.h"
+#include "cs_wire.h"
+#include "cs_frag.h"
+
+// delivery of chat lines in the configured order, on the worker that owns
+// the room: what a server does with its own clients' lines and with
+// messages from the other servers
+#define TOTAL_BATCH_BYTES (MSG_BUFSIZE - WIRE_HEADER - 1) // batch must fit a datagram
+
+extern int order_mode; // 0 unordered, 1 fifo, 2 total, 3 sequencer
+extern int total_window;
+extern int total_batch;
+extern address selfAddr;
+extern vector<address> forwAddresses;
+extern vector<struct sockaddr_in> peerDests; // every server except self
+extern thread_local fragPool reassembly;
+extern thread_local unordered_map<fifoKey, fifoStream, fifoKeyHash> fifoStreamMap;
+extern thread_local map<int, total_s> totalSenderMap;
+extern thread_local map<int, total_r> totalReceiverMap;
+extern thread_local map<int, int> seqCounterMap;
+extern thread_local map<int, seq_r> seqReceiverMap;
+
+void handlePeer(address sender, wireMsg const &m);
+void room_publish(int roomId, int count, address client, msgRef const &msg);
+int plainWireType();
+void forwardToServers(wireMsg const &m);
+void sendToServer(address server, wireMsg const &m);
+void b_deliver(int roomId, msgRef const &msg);
+void b_deliver(int roomId, const char *msg, int len);
+void fifo_deliver(wireMsg const &m);
+void total_sendInitial(int roomId);
+void total_sendFinal(int roomId, int msgId);
+void total_handle(struct address sender, wireMsg const &m);
+void total_updateReceiverQueue(int roomId, int T, int oldP);
+void total_holdback(holdbackQueue &queue, totalMsg const &m);
+void total_deliver(int roomId, totalMsg const &m);
+void unordered_deliver(wireMsg const &m);
+int seq_server(int roomId);
+void seq_assign(int roomId, msgRef const &msg);
+void seq_handle(struct address sender, wireMsg const &m);
+
+#endif
@@ -0,0 +1,17 @@
+#include "cs_relay.h"
+#include "cs_wire.h"
+
+int relay_degree = 0;
+
+bool relay_enabled(int wireType) {
+    return relay_degree > 0 && !wire_text && (wireType == WIRE_UNORDERED || wireType == WIRE_FIFO);
+}
+
+// server indexes (0-based) self forwards a message from origin to
+void relay_children(int origin, int self, vector<int> &out) {
+    out.clear();
+    int pos = (self - origin + N) % N;
+    for (int c = pos * relay_degree + 1; c <= pos * relay_degree + relay_degree && c < N; c++) {
+        out.push_back((origin + c) % N);
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef __cs_relay_h_
+#define __cs_relay_h_
+#include "cs_common.h"
+
+// relay trees for unordered and FIFO traffic (binary wire format). the
+// servers of config.txt, rotated to start at the origin, form a heap
+// ordered relay_degree-ary tree: position r forwards to r*k+1 .. r*k+k.
+// every server sends at most relay_degree copies of a message, and the
+// messages of one origin always take the same path
+extern int relay_degree; // 0: the origin sends to every server itself
+
+bool relay_enabled(int wireType);
+void relay_children(int origin, int self, vector<int> &out);
+
+#endif
@@ -0,0 +1,68 @@
+#include "cs_room.h"
+#include "cs_index.h"
+#include "cs_interest.h"
+#include "cs_group.h"
+
+// where each member sits in its room's arrays, keyed by client address
+static thread_local addrIndex memberSlots;
+
+chatroom *room_find(int roomId) {
+    map<int, chatroom>::iterator it = chatrooms.find(roomId);
+    if (it == chatrooms.end()) return NULL;
+    return &it->second;
+}
+
+// append the client to the member array, false if it is already in a room here
+bool room_add(int roomId, address client) {
+    indexEntry *e = index_insert(memberSlots, client);
+    if (e->kind == INDEX_MEMBER) return false;
+    chatroom &room = chatrooms[roomId];
+    e->kind = INDEX_MEMBER;
+    e->room = roomId;
+    e->slot = room.members.size();
+    room.members.push_back(client);
+    room.dests.push_back(toSockaddr(client));
+    return true;
+}
+
+// swap-remove: the last member takes over the leaving client's slot.
+// false if the client is not in this room
+bool room_remove(int roomId, address client) {
+    indexEntry *e = index_find(memberSlots, client);
+    if (e == NULL || e->room != roomId) return false;
+    chatroom &room = chatrooms[roomId];
+    int slot = e->slot;
+    int last = room.members.size() - 1;
+    if (slot != last) {
+        room.members[slot] = room.members[last];
+        room.dests[slot] = room.dests[last];
+        index_find(memberSlots, room.members[slot])->slot = slot;
+    }
+    room.members.pop_back();
+    room.dests.pop_back();
+    index_erase(memberSlots, client);
+    if (room.members.empty()) chatrooms.erase(roomId);
+    return true;
+}
+
+void room_join(int roomId, address client) {
+    if (!room_add(roomId, client)) {
+        if (debug_mode) debug_msg("Client is already in a chat room:", formatAddress(client).c_str());
+        return;
+    }
+    if (chatrooms[roomId].members.size() == 1) {
+        interest_changed(roomId, true);
+        group_changed(roomId, true);
+    }
+}
+
+void room_leave(int roomId, address client) {
+    if (!room_remove(roomId, client)) {
+        if (debug_mode) debug_msg("Client was not in chat room #", roomId);
+        return;
+    }
+    if (room_find(roomId) == NULL) {
+        interest_changed(roomId, false);
+        group_changed(roomId, false);
+    }
+}
@@ -0,0 +1,12 @@
+#ifndef __cs_room_h_
+#define __cs_room_h_
+#include "cs_common.h"
+
+// membership of the chatrooms owned by this worker
+chatroom *room_find(int roomId);
+bool room_add(int roomId, address client);
+bool room_remove(int roomId, address client);
+void room_join(int roomId, address client);
+void room_leave(int roomId, address client);
+
+#endif
@@ -0,0 +1,107 @@
+#include "cs_sendq.h"
+#include "cs_fanout.h"
+#include "cs_index.h"
+#include "cs_metrics.h"
+#include "cs_transport.h"
+#include <errno.h>
+#include <deque>
+
+int sendq_limit = SENDQ_LIMIT;
+
+struct sendQueue {
+    struct sockaddr_in to;
+    bool peer;
+    deque<msgRef> msgs;
+};
+
+static thread_local eventLoop *qloop; // NULL: no queueing, a full socket is an error
+static thread_local int qfd = -1;
+static thread_local map<address, sendQueue> queues; // only destinations with something waiting
+static thread_local deque<address> ready; // drain order
+static thread_local struct mmsghdr qmsgs[FANOUT_BATCH];
+static thread_local struct iovec qiov[FANOUT_BATCH];
+
+// on the worker that owns fd, before anything is sent
+void sendq_init(eventLoop &loop, int fd) {
+    qloop = &loop;
+    qfd = fd;
+}
+
+// datagrams are waiting, new ones have to go behind them
+bool sendq_busy() {
+    return !ready.empty();
+}
+
+void sendq_push(struct sockaddr_in const &to, msgRef const &msg) {
+    metrics &mt = metrics_local();
+    if (qloop == NULL) {
+        metric_add(mt.sendErrors);
+        return;
+    }
+    address dest = toAddress(to);
+    sendQueue &q = queues[dest];
+    if (q.msgs.empty()) {
+        indexEntry *e = index_find(endpoints, dest);
+        q.to = to;
+        q.peer = e != NULL && e->kind == INDEX_PEER;
+        if (ready.empty()) event_mod(*qloop, qfd, EV_READ | EV_WRITE);
+        ready.push_back(dest);
+    }
+    int cap = q.peer ? sendq_limit * SENDQ_PEER_SCALE : sendq_limit;
+    if (q.msgs.size() >= cap) {
+        metric_add(mt.sendDropped);
+        if (q.peer) return;
+        q.msgs.pop_front();
+        metric_add(mt.sendQueue, -1);
+    }
+    q.msgs.push_back(msg);
+    metric_add(mt.sendQueued);
+    metric_add(mt.sendQueue);
+    metric_max(mt.sendQueueMax, mt.sendQueue.load(memory_order_relaxed));
+}
+
+// the head of the queue that is first in line went out (or failed)
+static void popFront() {
+    address dest = ready.front();
+    ready.pop_front();
+    map<address, sendQueue>::iterator it = queues.find(dest);
+    it->second.msgs.pop_front();
+    metric_add(metrics_local().sendQueue, -1);
+    if (it->second.msgs.empty()) queues.erase(it);
+    else ready.push_back(dest);
+}
+
+// socket is writable: send heads of the queues until it is full again
+void sendq_drain() {
+    if (ready.empty()) return;
+    while (!ready.empty()) {
+        int n = min((int) ready.size(), FANOUT_BATCH);
+        for (int i = 0; i < n; i++) {
+            sendQueue &q = queues[ready[i]];
+            msgRef &m = q.msgs.front();
+            qiov[i].iov_base = (void*) m.data();
+            qiov[i].iov_len = m.size();
+            memset(&qmsgs[i], 0, sizeof(qmsgs[i]));
+            qmsgs[i].msg_hdr.msg_name = &q.to;
+            qmsgs[i].msg_hdr.msg_namelen = sizeof(q.to);
+            qmsgs[i].msg_hdr.msg_iov = &qiov[i];
+            qmsgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int status = net_sendmmsg(qfd, qmsgs, n, 0);
+        fstats.calls++;
+        if (status < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) return;
+            // the first datagram failed, skip it and go on
+            fstats.errors++;
+            metric_add(metrics_local().sendErrors);
+            popFront();
+            continue;
+        }
+        fstats.datagrams += status;
+        for (int i = 0; i < status; i++) popFront();
+        if (status < n) return; // full again
+    }
+    event_mod(*qloop, qfd, EV_READ);
+    if (debug_mode) debug_msg("Send queues drained");
+}
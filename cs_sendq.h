@@ -0,0 +1,23 @@
+#ifndef __cs_sendq_h_
+#define __cs_sendq_h_
+#include "cs_common.h"
+#include "cs_event.h"
+
+// per-destination send queues behind the worker's non-blocking socket.
+// once a send finds the socket buffer full, every datagram waits in its
+// destination's queue (keeps per-destination order) until the socket is
+// writable again; the queues drain round robin, one datagram each per pass.
+// a full client queue drops its oldest datagram, a slow reader gets the
+// newest lines; a full peer queue (SENDQ_PEER_SCALE times larger) drops the
+// new datagram
+#define SENDQ_LIMIT 256
+#define SENDQ_PEER_SCALE 16
+
+extern int sendq_limit; // datagrams per client destination
+
+void sendq_init(eventLoop &loop, int fd);
+bool sendq_busy();
+void sendq_push(struct sockaddr_in const &to, msgRef const &msg);
+void sendq_drain();
+
+#endif
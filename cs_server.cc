@@ -0,0 +1,207 @@
+#include "cs_server.h"
+#include "cs_client.h"
+#include "cs_shard.h"
+#include "cs_wire.h"
+#include "cs_index.h"
+#include "cs_room.h"
+#include "cs_order.h"
+#include "cs_metrics.h"
+#include "cs_idle.h"
+#include <errno.h>
+#include <limits.h>
+
+#define LINE_RESERVE (WIRE_MAXHEAD + WIRE_HEADER) // headroom a chat line keeps for wire and fragment headers
+
+// client data, kept by the worker the client's datagrams arrive at
+thread_local map<address,clientInfo> clients; // client addresses to nicknames 
+thread_local addrIndex endpoints; // one probe tells peer, known client or new client
+// room data, kept by the worker owning the room (see shard_owner)
+thread_local map<int, chatroom> chatrooms;
+
+static inline std::string &rtrim(std::string &s) {
+    s.erase(find_if(s.rbegin(), s.rend(),
+                std::not1(std::ptr_fun<int, int>(std::isspace))).base(), s.end());
+    return s;
+}
+
+// a message from another server, handled by the worker owning its room
+static void routePeer(address src, wireMsg &m, msgRef pkt) {
+    m.owner = pkt.buf;
+    if (shard_owner(m.roomId) == workerId) {
+        handlePeer(src, m);
+    } else { // the owner gets the buffer itself
+        handoffItem item = { HANDOFF_PEER, m.roomId, src, 0, std::move(pkt) };
+        shard_run(item);
+    }
+}
+
+void handlePacket(address src, msgRef pkt) {
+    indexEntry *e = index_find(endpoints, src);
+    // if from another server
+    if (e != NULL && e->kind == INDEX_PEER) {
+        metric_add(metrics_local().peerIn[e->peer]);
+        wireMsg m;
+        if (!wire_parse(pkt.data(), pkt.size(), plainWireType(), m)) {
+            if (debug_mode) debug_msg("Dropped malformed server message");
+            return;
+        }
+        if (m.type != WIRE_BUNDLE) {
+            routePeer(src, m, std::move(pkt));
+            return;
+        }
+        // every message of a bundle keeps a view of the datagram
+        const char *p = m.payload, *end = m.payload + m.len, *inner;
+        int len;
+        while (wire_batchNext(p, end, inner, len)) {
+            wireMsg im;
+            if (!wire_parse(inner, len, plainWireType(), im) || im.type == WIRE_BUNDLE) {
+                if (debug_mode) debug_msg("Dropped malformed message in bundle");
+                continue;
+            }
+            routePeer(src, im, msgref_view(pkt.buf, inner, len));
+        }
+    } 
+    // from an existing client
+    else if (e != NULL) {
+        metric_add(metrics_local().clientIn);
+        idle_seen(*e->client);
+        handleExistingClient(*e->client, std::move(pkt));
+    }
+    // from a new client
+    else {
+        metric_add(metrics_local().clientIn);
+        handleNewClient(src, msgref_str(pkt));
+    }
+}
+
+// work for a chatroom this worker owns
+void runHandoff(handoffItem &item) {
+    if (item.kind == HANDOFF_PEER) {
+        wireMsg m;
+        wire_parse(item.msg.data(), item.msg.size(), plainWireType(), m);
+        m.owner = item.msg.buf;
+        handlePeer(item.src, m);
+    } else if (item.kind == HANDOFF_MESSAGE) {
+        room_publish(item.roomId, item.count, item.src, item.msg);
+    } else if (item.kind == HANDOFF_JOIN) {
+        room_join(item.roomId, item.src);
+    } else if (item.kind == HANDOFF_LEAVE) {
+        room_leave(item.roomId, item.src);
+    }
+}
+
+// the line stays in the buffer it arrived in, the nick goes into its headroom
+void client_message(clientInfo &client, msgRef line) {
+    int currRoomId = client.roomId;
+    if (currRoomId == 0) {
+        sendResponse(client.addr, "-ERR Please join a room first");
+        return;
+    }
+    if (!client_allow(client)) return;
+    string prefix = "<" + client.nickname + "> ";
+    if (prefix.size() + line.size() > MSG_MAXLINE) {
+        sendResponse(client.addr, "-ERR Message too long");
+        return;
+    }
+    msgRef msg = std::move(line);
+    char *p = NULL;
+    if (msgref_headroom(msg) >= prefix.size() + LINE_RESERVE) p = msgref_prepend(msg, prefix.size());
+    if (p == NULL) { // long nickname, or someone else holds the buffer
+        msgRef copy = msgref_alloc(prefix.size() + msg.size());
+        p = msgref_writable(copy);
+        memcpy(p + prefix.size(), msg.data(), msg.size());
+        msg = std::move(copy);
+    }
+    memcpy(p, prefix.data(), prefix.size());
+    int count = ++client.counts[currRoomId];
+    if (debug_mode) debug_msg("Local client sent:", msgref_str(msg).c_str());
+    handoffItem item = { HANDOFF_MESSAGE, currRoomId, client.addr, count, msg };
+    shard_run(item);
+}
+
+// room number after "/join ", 0 if it is not a number from 1 to INT_MAX
+static int parseRoom(string const &msg) {
+    const char *arg = msg.c_str() + 6;
+    char *end;
+    errno = 0;
+    long room = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || errno == ERANGE || room < 1 || room > INT_MAX) return 0;
+    return room;
+}
+
+// Add new client to list of active clients 
+void handleNewClient(address client, string msg) {
+        rtrim(msg);
+        if (msg.empty()) return; // keepalive from a client we no longer know
+        // the report is large, answering any source address would let a
+        // spoofed datagram reflect it; without a join only local tools get it
+        if (msg == "/stats" && (ntohl(client.addr) >> 24) == 127) {
+            metric_add(metrics_local().commands[CMD_STATS]);
+            sendResponse(client, metrics_report().c_str());
+            return;
+        }
+        if (msg.substr(0,6) != "/join ") {
+            sendResponse(client, "-ERR please join a room first");
+            return;
+        }
+        assert (msg.substr(0,6) == "/join ");
+        
+        int roomId = parseRoom(msg);
+        if (roomId == 0) {
+            sendResponse(client, "-ERR Not a valid room number");
+            return;
+        }
+        string addrId = formatAddress(client);
+        
+        // add client to list of clients
+        struct clientInfo initInfo = { client, addrId, addrId, roomId };
+        clients[client] = initInfo; 
+        indexEntry *e = index_insert(endpoints, client);
+        e->kind = INDEX_CLIENT;
+        e->client = &clients[client];
+        idle_watch(clients[client]);
+        metric_add(metrics_local().clients);
+        metric_add(metrics_local().commands[CMD_JOIN]);
+        client_enterRoom(client, roomId);
+        
+        sendResponse(client, "+OK You are now in chat room #", roomId);
+        if (debug_mode) debug_msg("New client joined room #", roomId);
+}
+
+void handleExistingClient(clientInfo &client, msgRef pkt) {
+    while (pkt.len > 0 && isspace(pkt.data()[pkt.len - 1])) pkt.len--;
+    if (pkt.empty()) return; // keepalive, the datagram alone counts (cs_idle.h)
+    metrics &mt = metrics_local();
+    if (pkt.data()[0] != '/') { // client sends a message to the group
+        metric_add(mt.commands[CMD_MESSAGE]);
+        client_message(client, std::move(pkt));
+        return;
+    }
+    string msg = msgref_str(pkt);
+    if (msg == "/join" || msg == "/nick") {
+        sendResponse(client.addr, "-ERR You need an argument");
+
+    } else if (msg.substr(0,6) == "/join ") {
+        metric_add(mt.commands[CMD_JOIN]);
+        int newroom = parseRoom(msg);
+        if (newroom == 0) sendResponse(client.addr, "-ERR Not a valid room number");
+        else client_join(client, newroom);
+    } else if (msg.substr(0,5) == "/part") {
+        metric_add(mt.commands[CMD_PART]);
+        client_part(client);
+    } else if (msg.substr(0,6) == "/nick ") {
+        metric_add(mt.commands[CMD_NICK]);
+        string name = msg.substr(6);
+        client_nick(client, name);
+    } else if (msg.substr(0,5) == "/quit") {
+        metric_add(mt.commands[CMD_QUIT]);
+        client_quit(client);
+    } else if (msg == "/stats") {
+        metric_add(mt.commands[CMD_STATS]);
+        sendResponse(client.addr, metrics_report().c_str());
+    } 
+    else {
+        metric_add(mt.commands[CMD_MESSAGE]);
+        client_message(client, std::move(pkt));
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef __cs_server_h_
+#define __cs_server_h_
+#include "cs_common.h"
+#include "cs_shard.h"
+
+// what a worker does with one received datagram: peer messages go to the
+// ordering protocol, client datagrams are commands or chat lines
+void handlePacket(address src, msgRef pkt);
+void runHandoff(handoffItem &item);
+void handleNewClient(address client, string msg);
+void handleExistingClient(clientInfo &client, msgRef pkt);
+
+#endif
@@ -0,0 +1,107 @@
+#include "cs_shard.h"
+#include <mutex>
+#include <sys/eventfd.h>
+
+#define SOCKET_RCVBUF (4 << 20) // capped by net.core.rmem_max
+
+// pending work for one worker, filled by the others
+struct shardQueue {
+    mutex lock;
+    vector<handoffItem> items;
+    int efd; // wakes up the owner's event loop
+};
+
+int nthreads = 1;
+thread_local int workerId = 0;
+
+static vector<shardQueue*> queues;
+static handoffHandler runItem;
+
+static void onHandoff(int fd, int events, void *arg);
+
+void shard_init(int threads, handoffHandler handler) {
+    nthreads = threads;
+    runItem = handler;
+    for (int i = 0; i < threads; i++) {
+        shardQueue *q = new shardQueue();
+        q->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (q->efd < 0) throwSysError("eventfd failed");
+        queues.push_back(q);
+    }
+}
+
+// register the calling worker's handoff queue with its event loop
+void shard_attach(eventLoop &loop) {
+    event_add(loop, queues[workerId]->efd, EV_READ, onHandoff, NULL);
+}
+
+// worker that owns the chatroom and all of its ordering state
+int shard_owner(int roomId) {
+    if (nthreads == 1) return 0;
+    return ((unsigned) roomId) % nthreads;
+}
+
+// run the item here if this worker owns its room, else queue it for the owner.
+// items from one worker to another stay in order
+void shard_run(handoffItem &item) {
+    int owner = shard_owner(item.roomId);
+    if (owner == workerId) {
+        runItem(item);
+        return;
+    }
+    shardQueue *q = queues[owner];
+    bool wasEmpty;
+    {
+        lock_guard<mutex> guard(q->lock);
+        wasEmpty = q->items.empty();
+        q->items.push_back(item);
+    }
+    if (wasEmpty) {
+        uint64_t one = 1;
+        if (write(q->efd, &one, sizeof(one)) < 0 && debug_mode) {
+            debug_msg("Error waking up worker", owner);
+        }
+    }
+}
+
+static void onHandoff(int fd, int events, void *arg) {
+    uint64_t val;
+    if (read(fd, &val, sizeof(val)) < 0) return;
+    static thread_local vector<handoffItem> batch;
+    shardQueue *q = queues[workerId];
+    {
+        lock_guard<mutex> guard(q->lock);
+        batch.swap(q->items);
+    }
+    for (int i = 0; i < batch.size(); i++) runItem(batch[i]);
+    batch.clear();
+}
+
+// udp socket bound to the server address; with several workers every one
+// binds its own and the kernel spreads senders across them
+int shard_socket(address bindAddr) {
+    int fd = socket(PF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0); // a full buffer queues, see cs_sendq.h
+    if (fd < 0) throwSysError("Failed to create socket");
+    if (nthreads > 1) {
+        int one = 1;
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+            throwSysError("Failed to set SO_REUSEPORT");
+        }
+    }
+    // pipelined ordering rounds arrive in bursts, leave room for them. the
+    // kernel caps the size at net.core.rmem_max without failing, so what we
+    // got is read back; a smaller buffer still works, it just drops sooner
+    int rcvbuf = SOCKET_RCVBUF;
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0) {
+        if (debug_mode) debug_msg("Failed to set SO_RCVBUF");
+    }
+    socklen_t len = sizeof(rcvbuf);
+    if (debug_mode && getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &len) == 0) {
+        debug_msg("Socket receive buffer bytes:", rcvbuf);
+    }
+    struct sockaddr_in servaddr = toSockaddr(bindAddr);
+    if (::bind(fd, (struct sockaddr*) &servaddr, sizeof(servaddr)) < 0) {
+        throwSysError("Socket did not bind");
+    }
+    return fd;
+}
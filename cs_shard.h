@@ -0,0 +1,31 @@
+#ifndef __cs_shard_h_
+#define __cs_shard_h_
+#include "cs_common.h"
+#include "cs_event.h"
+
+// kinds of work one worker hands to the worker owning a chatroom
+#define HANDOFF_PEER 0    // datagram from another server
+#define HANDOFF_MESSAGE 1 // chat line from a client of this server
+#define HANDOFF_JOIN 2    // client enters the room
+#define HANDOFF_LEAVE 3   // client leaves the room
+
+struct handoffItem {
+    int kind;
+    int roomId;
+    address src; // peer server or client
+    int count;   // per-room message count of the client (HANDOFF_MESSAGE)
+    msgRef msg;  // chat line, or the raw datagram for HANDOFF_PEER
+};
+
+typedef void (*handoffHandler)(handoffItem &item);
+
+extern int nthreads;
+extern thread_local int workerId;
+
+void shard_init(int threads, handoffHandler handler);
+void shard_attach(eventLoop &loop);
+int shard_owner(int roomId);
+void shard_run(handoffItem &item);
+int shard_socket(address bindAddr);
+
+#endif
@@ -0,0 +1,17 @@
+#include "cs_transport.h"
+
+static int kernelSend(int fd, struct mmsghdr *msgs, unsigned int count, int flags) {
+    return sendmmsg(fd, msgs, count, flags);
+}
+
+static int kernelRecv(int fd, struct mmsghdr *msgs, unsigned int count, int flags) {
+    return recvmmsg(fd, msgs, count, flags, NULL);
+}
+
+transport kernelTransport = { kernelSend, kernelRecv };
+transport *netTransport = &kernelTransport;
+
+// before any worker starts, the pointer is read without a lock
+void transport_set(transport *t) {
+    netTransport = t;
+}
@@ -0,0 +1,26 @@
+#ifndef __cs_transport_h_
+#define __cs_transport_h_
+#include "cs_common.h"
+
+// where the server's datagrams go out and come in: the kernel's UDP
+// sockets by default, or a simulated network (see chatsim.cc). both calls
+// behave like sendmmsg and recvmmsg
+struct transport {
+    int (*sendBatch)(int fd, struct mmsghdr *msgs, unsigned int count, int flags);
+    int (*recvBatch)(int fd, struct mmsghdr *msgs, unsigned int count, int flags);
+};
+
+extern transport kernelTransport;
+extern transport *netTransport;
+
+void transport_set(transport *t);
+
+inline int net_sendmmsg(int fd, struct mmsghdr *msgs, unsigned int count, int flags) {
+    return netTransport->sendBatch(fd, msgs, count, flags);
+}
+
+inline int net_recvmmsg(int fd, struct mmsghdr *msgs, unsigned int count, int flags) {
+    return netTransport->recvBatch(fd, msgs, count, flags);
+}
+
+#endif
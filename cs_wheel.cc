@@ -0,0 +1,88 @@
+#include "cs_wheel.h"
+
+void wheel_init(timerWheel &w) {
+    w.now = 0;
+    for (int l = 0; l < WHEEL_LEVELS; l++) {
+        for (int s = 0; s < WHEEL_SLOTS; s++) {
+            w.slots[l][s].prev = w.slots[l][s].next = &w.slots[l][s];
+        }
+    }
+}
+
+// the lowest level whose span reaches the expiry, the slot it falls in there
+static wheelTimer *slotOf(timerWheel &w, uint64_t expires) {
+    uint64_t delta = expires - w.now;
+    int l = 0;
+    while (l < WHEEL_LEVELS - 1 && delta >= (1ULL << (WHEEL_BITS * (l + 1)))) l++;
+    return &w.slots[l][(expires >> (WHEEL_BITS * l)) & (WHEEL_SLOTS - 1)];
+}
+
+static void link(timerWheel &w, wheelTimer *t) {
+    wheelTimer *head = slotOf(w, t->expires);
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+// (re)arm for the given tick, one in the past fires on the next advance
+void wheel_add(timerWheel &w, wheelTimer *t, uint64_t expires) {
+    wheel_del(t);
+    if (expires <= w.now) expires = w.now + 1;
+    if (expires - w.now > WHEEL_MAXSPAN) expires = w.now + WHEEL_MAXSPAN;
+    t->expires = expires;
+    link(w, t);
+}
+
+void wheel_del(wheelTimer *t) {
+    if (t->next == NULL) return;
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->prev = t->next = NULL;
+}
+
+bool wheel_pending(wheelTimer const *t) {
+    return t->next != NULL;
+}
+
+// take a slot's list off the wheel, the head is left empty
+static void detach(wheelTimer *head, wheelTimer &list) {
+    if (head->next == head) {
+        list.prev = list.next = &list;
+        return;
+    }
+    list.next = head->next;
+    list.prev = head->prev;
+    list.next->prev = list.prev->next = &list;
+    head->prev = head->next = head;
+}
+
+static wheelTimer *popFront(wheelTimer &list) {
+    wheelTimer *t = list.next;
+    if (t == &list) return NULL;
+    list.next = t->next;
+    t->next->prev = &list;
+    t->prev = t->next = NULL;
+    return t;
+}
+
+// one tick: higher wheels whose slot comes up spill into the lower ones,
+// then everything in the current level 0 slot fires
+static void step(timerWheel &w) {
+    w.now++;
+    for (int l = 1; l < WHEEL_LEVELS; l++) {
+        if ((w.now & ((1ULL << (WHEEL_BITS * l)) - 1)) != 0) break;
+        wheelTimer list;
+        detach(&w.slots[l][(w.now >> (WHEEL_BITS * l)) & (WHEEL_SLOTS - 1)], list);
+        wheelTimer *t;
+        while ((t = popFront(list)) != NULL) link(w, t); // may be due this very tick
+    }
+    wheelTimer list;
+    detach(&w.slots[0][w.now & (WHEEL_SLOTS - 1)], list);
+    wheelTimer *t;
+    while ((t = popFront(list)) != NULL) t->fire(t->arg);
+}
+
+void wheel_advance(timerWheel &w, uint64_t to) {
+    while (w.now < to) step(w);
+}
@@ -0,0 +1,33 @@
+#ifndef __cs_wheel_h_
+#define __cs_wheel_h_
+#include <stddef.h>
+#include <stdint.h>
+
+// hierarchical timer wheel: WHEEL_LEVELS wheels of WHEEL_SLOTS slots, a
+// slot of level l spans WHEEL_SLOTS^l ticks. add and delete are O(1) list
+// operations on a timer the caller owns; a timer moves down a level when the
+// lower wheel wraps around, at most WHEEL_LEVELS-1 times
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+#define WHEEL_MAXSPAN ((1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1) // ticks, farther is clamped
+
+struct wheelTimer {
+    wheelTimer *prev, *next; // in a slot's list, NULL when not pending
+    uint64_t expires; // tick
+    void (*fire)(void *arg); // the timer is off the wheel when this runs
+    void *arg;
+};
+
+struct timerWheel {
+    uint64_t now; // ticks so far
+    wheelTimer slots[WHEEL_LEVELS][WHEEL_SLOTS]; // list heads
+};
+
+void wheel_init(timerWheel &w);
+void wheel_add(timerWheel &w, wheelTimer *t, uint64_t expires);
+void wheel_del(wheelTimer *t);
+bool wheel_pending(wheelTimer const *t);
+void wheel_advance(timerWheel &w, uint64_t to);
+
+#endif
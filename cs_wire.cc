@@ -0,0 +1,190 @@
+#include "cs_wire.h"
+
+int wire_text = 0;
+
+static void put16(char *p, uint16_t v) { memcpy(p, &v, 2); }
+static void put32(char *p, uint32_t v) { memcpy(p, &v, 4); }
+static uint16_t get16(const char *p) { uint16_t v; memcpy(&v, p, 2); return v; }
+static uint32_t get32(const char *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+// reads a decimal number and the separator after it, false if malformed
+static bool parseInt(const char *&p, const char *end, char sep, int &out) {
+    bool neg = (p < end && *p == '-');
+    if (neg) p++;
+    const char *start = p;
+    long val = 0;
+    while (p < end && *p >= '0' && *p <= '9') val = val * 10 + (*p++ - '0');
+    if (p == start) return false;
+    out = neg ? -val : val;
+    if (sep == 0) return true;
+    if (p == end || *p != sep) return false;
+    p++;
+    return true;
+}
+
+// <ip>:<port>, without touching the heap
+static bool parseAddress(const char *&p, const char *end, char sep, address &out) {
+    const char *col = (const char*) memchr(p, ':', end - p);
+    if (col == NULL || col - p >= INET_ADDRSTRLEN) return false;
+    char ip[INET_ADDRSTRLEN];
+    memcpy(ip, p, col - p);
+    ip[col - p] = 0;
+    if (inet_pton(AF_INET, ip, &out.addr) != 1) return false;
+    p = col + 1;
+    int port;
+    if (!parseInt(p, end, sep, port)) return false;
+    out.port = htons(port);
+    return true;
+}
+
+static bool parseText(const char *p, const char *end, int plainType, wireMsg &out) {
+    if (p == end) return false;
+    if (*p == 'P') {
+        out.type = WIRE_PROPOSAL;
+        p++;
+        return parseInt(p, end, ',', out.seq) && parseInt(p, end, 0, out.roomId);
+    }
+    if (*p == 'T') {
+        out.type = WIRE_FINAL;
+        p++;
+        if (!parseInt(p, end, ',', out.stamp) || !parseInt(p, end, ',', out.seq) ||
+            !parseInt(p, end, ',', out.roomId)) return false;
+    } else if (*p == 'Q') {
+        out.type = WIRE_SEQ_REQUEST;
+        p++;
+        if (!parseInt(p, end, ',', out.roomId)) return false;
+    } else if (*p == 'S') {
+        out.type = WIRE_SEQ_ORDER;
+        p++;
+        if (!parseInt(p, end, ',', out.seq) || !parseInt(p, end, ',', out.roomId)) return false;
+    } else if (plainType == WIRE_FIFO) {
+        out.type = WIRE_FIFO;
+        if (!parseInt(p, end, ',', out.seq) || !parseAddress(p, end, ',', out.origin) ||
+            !parseInt(p, end, ',', out.roomId)) return false;
+    } else {
+        out.type = plainType;
+        if (!parseInt(p, end, ',', out.roomId)) return false;
+    }
+    out.payload = p;
+    out.len = end - p;
+    return true;
+}
+
+// fills out from a received datagram; the payload keeps pointing into buf.
+// plainType says how to read text messages that only carry a room id
+bool wire_parse(const char *buf, int len, int plainType, wireMsg &out) {
+    memset(&out, 0, sizeof(out));
+    if (len < 1 || (unsigned char) buf[0] != WIRE_MAGIC) {
+        return parseText(buf, buf + len, plainType, out);
+    }
+    if (len < WIRE_HEADER || buf[1] != WIRE_VERSION) return false;
+    out.type = buf[2];
+    out.flags = buf[3];
+    out.roomId = ntohl(get32(buf + 4));
+    out.seq = ntohl(get32(buf + 8));
+    out.stamp = ntohl(get32(buf + 12));
+    out.origin.addr = get32(buf + 16);
+    out.origin.port = get16(buf + 20);
+    out.len = ntohs(get16(buf + 22));
+    out.msgId = ntohl(get32(buf + 24));
+    out.payload = buf + WIRE_HEADER;
+    if (out.type < WIRE_UNORDERED || out.type > WIRE_GROUP) return false;
+    return out.len == len - WIRE_HEADER;
+}
+
+// writes the part of m that goes before the payload, returns its size.
+// head has room for WIRE_MAXHEAD bytes
+int wire_header(wireMsg const &m, char *head) {
+    if (!wire_text) {
+        head[0] = (char) WIRE_MAGIC;
+        head[1] = WIRE_VERSION;
+        head[2] = m.type;
+        head[3] = m.flags;
+        put32(head + 4, htonl(m.roomId));
+        put32(head + 8, htonl(m.seq));
+        put32(head + 12, htonl(m.stamp));
+        put32(head + 16, m.origin.addr);
+        put16(head + 20, m.origin.port);
+        put16(head + 22, htons(m.len));
+        put32(head + 24, htonl(m.msgId));
+        return WIRE_HEADER;
+    } else if (m.type == WIRE_PROPOSAL) {
+        return snprintf(head, WIRE_MAXHEAD, "P%d,%d", m.seq, m.roomId);
+    } else if (m.type == WIRE_FINAL) {
+        return snprintf(head, WIRE_MAXHEAD, "T%d,%d,%d,", m.stamp, m.seq, m.roomId);
+    } else if (m.type == WIRE_SEQ_REQUEST) {
+        return snprintf(head, WIRE_MAXHEAD, "Q%d,", m.roomId);
+    } else if (m.type == WIRE_SEQ_ORDER) {
+        return snprintf(head, WIRE_MAXHEAD, "S%d,%d,", m.seq, m.roomId);
+    } else if (m.type == WIRE_FIFO) {
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &m.origin.addr, ip, sizeof(ip));
+        return snprintf(head, WIRE_MAXHEAD, "%d,%s:%d,%d,", m.seq, ip, ntohs(m.origin.port), m.roomId);
+    }
+    return snprintf(head, WIRE_MAXHEAD, "%d,", m.roomId);
+}
+
+// writes m into buf, returns the datagram size or -1 if it does not fit
+int wire_encode(wireMsg const &m, char *buf, int cap) {
+    if (!wire_text && m.len > 0xffff) return -1;
+    char head[WIRE_MAXHEAD];
+    int n = wire_header(m, head);
+    if (n + m.len > cap) return -1;
+    memcpy(buf, head, n);
+    memcpy(buf + n, m.payload, m.len);
+    return n + m.len;
+}
+
+// writes the header into the headroom right before m.payload, so the payload
+// goes out where it already is. needs m.owner with nobody but the caller
+// holding it (others may read or write the same headroom, like
+// msgref_prepend); returns the datagram size and its start in out, or -1
+int wire_encodeFront(wireMsg const &m, char *&out) {
+    if (m.owner == NULL || m.payload == NULL || (!wire_text && m.len > 0xffff)) return -1;
+    if (m.owner->refs.load(std::memory_order_acquire) > 1) return -1;
+    char head[WIRE_MAXHEAD];
+    int n = wire_header(m, head);
+    char *payload = msgbuf_bytes(m.owner) + (m.payload - msgbuf_bytes(m.owner));
+    if (payload - msgbuf_bytes(m.owner) < n) return -1;
+    out = payload - n;
+    memcpy(out, head, n);
+    return n + m.len;
+}
+
+// writes one chat line of a batch payload at p, returns the bytes used
+int wire_batchAppend(char *p, const char *msg, int len) {
+    put16(p, htons(len));
+    memcpy(p + 2, msg, len);
+    return 2 + len;
+}
+
+// walks a batch payload, false once it is used up or truncated
+bool wire_batchNext(const char *&p, const char *end, const char *&msg, int &len) {
+    if (end - p < 2) return false;
+    len = ntohs(get16(p));
+    if (end - p - 2 < len) return false;
+    msg = p + 2;
+    p += 2 + len;
+    return true;
+}
+
+// a reference to the payload that can be kept after the datagram is handled
+msgRef wire_payload(wireMsg const &m) {
+    return msgref_view(m.owner, m.payload, m.len);
+}
+
+wireMsg wire_make(int type, int roomId, const char *payload, int len) {
+    wireMsg m;
+    memset(&m, 0, sizeof(m));
+    m.type = type;
+    m.roomId = roomId;
+    m.payload = payload;
+    m.len = len;
+    return m;
+}
+
+wireMsg wire_makeRef(int type, int roomId, msgRef const &payload) {
+    wireMsg m = wire_make(type, roomId, payload.data(), payload.size());
+    m.owner = payload.buf;
+    return m;
+}
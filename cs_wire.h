@@ -0,0 +1,63 @@
+#ifndef __cs_wire_h_
+#define __cs_wire_h_
+#include "cs_common.h"
+
+// server-to-server messages.
+// binary: fixed 28-byte header in network byte order followed by the payload
+//   magic(1) version(1) type(1) flags(1) roomId(4) seq(4) stamp(4)
+//   originAddr(4) originPort(2) len(2) msgId(4)
+// text (-w text, compatibility with older servers):
+//   unordered / initial  <roomId>,message
+//   fifo                 <seq>,<ip:port>,<roomId>,message
+//   proposal             P<seq>,<roomId>
+//   final                T<stamp>,<seq>,<roomId>,message
+//   sequencer request    Q<roomId>,message
+//   sequenced            S<seq>,<roomId>,message
+// text has no msgId, so total ordering runs with a window of 1 and no batches
+#define WIRE_MAGIC 0xC5
+#define WIRE_VERSION 2
+#define WIRE_HEADER 28
+#define WIRE_MAXSIZE MSGBUF_MAXLEN // largest encoded message, fits a large msgBuf
+#define WIRE_MAXHEAD 64 // room for a binary header or the longest text prefix
+
+#define WIRE_UNORDERED 1
+#define WIRE_FIFO 2
+#define WIRE_INITIAL 3  // total ordering: sender asks for proposals
+#define WIRE_PROPOSAL 4 // total ordering: receiver proposes a timestamp
+#define WIRE_FINAL 5    // total ordering: sender announces the agreed timestamp
+#define WIRE_SEQ_REQUEST 6 // sequencer ordering: ask the room's sequencer for a number
+#define WIRE_SEQ_ORDER 7   // sequencer ordering: numbered message from the sequencer
+#define WIRE_FRAGMENT 8    // piece of a larger message, see cs_frag.h
+#define WIRE_BUNDLE 9      // (len(2), encoded message)* for one server, see cs_coalesce.h
+#define WIRE_INTEREST 10   // seq 1/0: server msgId has members in the room or not, see cs_interest.h
+#define WIRE_GROUP 11      // total ordering: server's seq'th join (odd) or leave (even) of the room, see cs_group.h
+
+#define WIRE_FLAG_BATCH 1 // payload is a batch: (len(2), bytes)* per chat line
+#define WIRE_FLAG_RELAY 2 // travels along a relay tree, msgId = origin server number (cs_relay.h)
+
+struct wireMsg {
+    int type;
+    int flags;
+    int roomId;
+    int seq;        // fifo: message number of the client, total: proposed timestamp
+    int stamp;      // total: agreed timestamp, fifo: where the stream starts (cs_interest.h)
+    address origin; // fifo: client the message came from
+    int msgId;      // total: sender's id for the message (initial, proposal)
+    const char *payload; // points into the datagram, not owned
+    int len;
+    msgBuf *owner; // buffer holding payload, NULL if it is not in one
+};
+
+extern int wire_text; // encode in the old comma-separated format
+
+bool wire_parse(const char *buf, int len, int plainType, wireMsg &out);
+int wire_header(wireMsg const &m, char *head);
+int wire_encode(wireMsg const &m, char *buf, int cap);
+int wire_encodeFront(wireMsg const &m, char *&out);
+msgRef wire_payload(wireMsg const &m);
+wireMsg wire_make(int type, int roomId, const char *payload, int len);
+wireMsg wire_makeRef(int type, int roomId, msgRef const &payload);
+int wire_batchAppend(char *p, const char *msg, int len);
+bool wire_batchNext(const char *&p, const char *end, const char *&msg, int &len);
+
+#endif
@@ -0,0 +1,81 @@
+// Micro-benchmark: total ordering holdback queue, old vector+sort+erase
+// against the indexed holdbackQueue, at steady queue depths.
+// Prints one line per (impl, depth): impl depth ops ns_per_op
+// usage: ./holdback_bench [ops]
+#include "cs_holdback.h"
+#include "cs_bench.h"
+
+// the queue as total_updateReceiverQueue used to keep it
+struct legacyQueue {
+    vector<totalMsg> queue;
+};
+
+static bool legacyLess(const totalMsg &a, const totalMsg &b) {
+    return tie(a.timestamp, a.node.addr, a.node.port) < tie(b.timestamp, b.node.addr, b.node.port);
+}
+
+static void push(legacyQueue &q, totalMsg const &m) { q.queue.push_back(m); }
+static void push(holdbackQueue &q, totalMsg const &m) { holdback_push(q, m); }
+
+static void finalize(legacyQueue &q, int oldP, int T) {
+    vector<totalMsg> &queue = q.queue;
+    for (int i = 0; i < queue.size(); i++) {
+        if (!queue[i].deliverable && queue[i].timestamp == oldP) {
+            queue[i].deliverable = true;
+            queue[i].timestamp = T;
+            sort(queue.begin(), queue.end(), legacyLess);
+            break;
+        }
+    }
+}
+static void finalize(holdbackQueue &q, int oldP, int T) { holdback_finalize(q, oldP, T); }
+
+static int drain(legacyQueue &q) {
+    int n = 0;
+    while (!q.queue.empty() && q.queue[0].deliverable) {
+        q.queue.erase(q.queue.begin());
+        n++;
+    }
+    return n;
+}
+static int drain(holdbackQueue &q) {
+    int n = 0;
+    while (!holdback_empty(q) && holdback_front(q).deliverable) {
+        holdback_pop(q);
+        n++;
+    }
+    return n;
+}
+
+// the shared holdback load on one kind of queue, draining after each op
+template <class Q>
+struct queueLoad {
+    Q q;
+    address node;
+    msgRef line;
+    void hold(int P) { push(q, bench_totalMsg(P, node, line, 0)); }
+    void finalize(int oldP, int T) { ::finalize(q, oldP, T); }
+    void deliver() { drain(q); }
+};
+
+template <class Q>
+static double run(int depth, int ops) {
+    queueLoad<Q> load;
+    load.node.addr = htonl(0x7f000001);
+    load.node.port = htons(5000);
+    load.line = msgref_copy("<bench> holdback", 16);
+    return bench_holdbackLoad(load, depth, ops);
+}
+
+int main(int argc, char *argv[]) {
+    int depths[] = { 1000, 10000, 20000, 50000 };
+    int ops = argc > 1 ? atoi(argv[1]) : 100; // the legacy queue is slow
+    printf("impl depth ops ns_per_op\n");
+    for (int i = 0; i < 4; i++) {
+        double legacy = run<legacyQueue>(depths[i], ops);
+        printf("legacy %d %d %.0f\n", depths[i], ops, legacy);
+        double indexed = run<holdbackQueue>(depths[i], ops);
+        printf("indexed %d %d %.0f\n", depths[i], ops, indexed);
+    }
+    return 0;
+}
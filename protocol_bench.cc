@@ -0,0 +1,206 @@
+// Micro-benchmark: the server's protocol hot paths, run on one worker
+// against sink sockets that are never read.
+// Prints one line per (name, variant): name variant ops ns_per_op
+// usage: ./protocol_bench [ops]
+#include "cs_order.h"
+#include "cs_room.h"
+#include "cs_index.h"
+#include "cs_fifo.h"
+#include "cs_holdback.h"
+#include "cs_metrics.h"
+#include "cs_bench.h"
+
+// what chatserver.cc defines for the server
+thread_local int sockfd;
+int nn = 1;
+int N = 0;
+int debug_mode = 0;
+vector<address> forwAddresses;
+vector<struct sockaddr_in> peerDests;
+
+#define BENCH_EMPTY_ROOM 1 // no members, so delivery costs nothing
+#define BENCH_LINE "<bench> the quick brown fox jumps over the lazy dog"
+
+// a UDP socket on a free loopback port
+static address sinkSocket() {
+    int fd = socket(PF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) throwSysError("Failed to create socket");
+    struct sockaddr_in addr;
+    bzero(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) throwSysError("Failed to bind");
+    socklen_t size = sizeof(addr);
+    getsockname(fd, (struct sockaddr*) &addr, &size);
+    return toAddress(addr);
+}
+
+static double nsPerOp(chrono::steady_clock::time_point start, int ops) {
+    chrono::nanoseconds took = chrono::steady_clock::now() - start;
+    return (double) took.count() / ops;
+}
+
+static void report(const char *name, string const &variant, int ops, double ns) {
+    printf("%s %s %d %.0f\n", name, variant.c_str(), ops, ns);
+}
+
+// one datagram as a peer would send it
+static string encoded(wireMsg const &m) {
+    static char buf[WIRE_MAXSIZE];
+    int len = wire_encode(m, buf, sizeof(buf));
+    if (len < 0) throwMyError("Cannot encode benchmark message");
+    return string(buf, len);
+}
+
+// parse and deliver FIFO datagrams from one client; with reorder > 1 every
+// block of that many arrives backwards, so all but the last wait in the stream
+static void benchFifo(int ops, int reorder) {
+    fifoStreamMap.clear();
+    address origin = sinkSocket();
+    vector<string> pkts(ops);
+    for (int i = 0; i < ops; i++) {
+        int block = i / reorder * reorder;
+        int seq = min(ops, block + reorder) - (i - block); // 1-based, backwards in a block
+        wireMsg m = wire_make(WIRE_FIFO, BENCH_EMPTY_ROOM, BENCH_LINE, strlen(BENCH_LINE));
+        m.seq = seq;
+        m.origin = origin;
+        pkts[i] = encoded(m);
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < ops; i++) {
+        wireMsg m;
+        if (!wire_parse(pkts[i].data(), pkts[i].size(), WIRE_FIFO, m)) throwMyError("Bad FIFO datagram");
+        fifo_deliver(m);
+    }
+    double ns = nsPerOp(start, ops);
+    if (fifoStreamMap[fifo_key(origin, BENCH_EMPTY_ROOM)].lastMsgId != ops) {
+        throwMyError("FIFO stream did not deliver everything");
+    }
+    report("fifo_deliver", string(wire_text ? "text" : "binary") + "/reorder" + to_string(reorder),
+           ops, ns);
+}
+
+// parse initial messages from a peer (each answered with a proposal to the
+// sink), then the final timestamps that deliver them again in order
+static void benchTotalHandle(int ops) {
+    address peer = forwAddresses[1];
+    vector<string> initial(ops), final(ops);
+    int base = totalReceiverMap[BENCH_EMPTY_ROOM].A;
+    for (int i = 0; i < ops; i++) {
+        wireMsg m = wire_make(WIRE_INITIAL, BENCH_EMPTY_ROOM, BENCH_LINE, strlen(BENCH_LINE));
+        m.msgId = i + 1;
+        initial[i] = encoded(m);
+        m.type = WIRE_FINAL;
+        m.seq = base + i + 1; // our proposal
+        m.stamp = base + i + 1;
+        final[i] = encoded(m);
+    }
+    string format = wire_text ? "text" : "binary";
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < ops; i++) {
+        wireMsg m;
+        if (!wire_parse(initial[i].data(), initial[i].size(), WIRE_INITIAL, m)) {
+            throwMyError("Bad initial datagram");
+        }
+        total_handle(peer, m);
+    }
+    report("total_handle", format + "/initial", ops, nsPerOp(start, ops));
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < ops; i++) {
+        wireMsg m;
+        if (!wire_parse(final[i].data(), final[i].size(), WIRE_INITIAL, m)) {
+            throwMyError("Bad final datagram");
+        }
+        total_handle(peer, m);
+    }
+    report("total_handle", format + "/final", ops, nsPerOp(start, ops));
+    if (!holdback_empty(totalReceiverMap[BENCH_EMPTY_ROOM].queue)) {
+        throwMyError("Holdback queue not drained");
+    }
+}
+
+// the shared holdback load on one room's receiver queue, where
+// finalizing the oldest proposal delivers it
+struct receiverLoad {
+    int roomId;
+    total_r *rInfo;
+    address node;
+    msgRef line;
+    void hold(int P) { total_holdback(rInfo->queue, bench_totalMsg(P, node, line, metrics_nowUs())); }
+    void finalize(int oldP, int T) { total_updateReceiverQueue(roomId, T, oldP); }
+    void deliver() {}
+};
+
+static void benchUpdateReceiverQueue(int depth, int ops) {
+    receiverLoad load;
+    load.roomId = BENCH_EMPTY_ROOM + 1 + depth;
+    load.rInfo = &totalReceiverMap[load.roomId];
+    load.node = forwAddresses[1];
+    load.line = msgref_copy(BENCH_LINE, strlen(BENCH_LINE));
+    double ns = bench_holdbackLoad(load, depth, ops);
+    report("total_updateReceiverQueue", "depth" + to_string(depth), ops, ns);
+    totalReceiverMap.erase(load.roomId);
+}
+
+// one chat line to every member of a room
+static void benchDeliver(int members, int ops) {
+    int roomId = BENCH_EMPTY_ROOM + 100000 + members;
+    for (int i = 0; i < members; i++) room_add(roomId, sinkSocket());
+    msgRef line = msgref_copy(BENCH_LINE, strlen(BENCH_LINE));
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < ops; i++) b_deliver(roomId, line);
+    report("b_deliver", "members" + to_string(members), ops, nsPerOp(start, ops));
+}
+
+// reading a config file of the given size
+static void benchPopulate(int servers, int ops) {
+    char path[] = "/tmp/protocol_benchXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) throwSysError("Failed to create config file");
+    FILE *f = fdopen(fd, "w");
+    for (int i = 0; i < servers; i++) {
+        fprintf(f, "127.0.0.1:%d,127.0.0.1:%d\n", 5000 + i, 6000 + i);
+    }
+    fclose(f);
+    int saved = N;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < ops; i++) {
+        vector<address> f, b;
+        populateServers(f, b, path);
+    }
+    double ns = nsPerOp(start, ops);
+    N = saved;
+    unlink(path);
+    report("populateServers", "servers" + to_string(servers), ops, ns);
+}
+
+int main(int argc, char *argv[]) {
+    int ops = argc > 1 ? atoi(argv[1]) : 20000;
+    if (ops < 1) throwMyError("Bad number of ops");
+
+    // we are server 1 of 2, server 2 is a sink
+    address self = sinkSocket(), peer = sinkSocket();
+    sockfd = socket(PF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) throwSysError("Failed to create socket");
+    forwAddresses.push_back(self);
+    forwAddresses.push_back(peer);
+    peerDests.push_back(toSockaddr(peer));
+    N = 2;
+    selfAddr = self;
+    metrics_init(N);
+
+    printf("name variant ops ns_per_op\n");
+    for (wire_text = 0; wire_text <= 1; wire_text++) {
+        benchFifo(ops, 1);
+        benchFifo(ops, 16);
+        benchTotalHandle(ops);
+    }
+    wire_text = 0;
+    int depths[] = { 0, 100, 1000, 10000 };
+    for (int i = 0; i < 4; i++) benchUpdateReceiverQueue(depths[i], ops);
+    int members[] = { 1, 16, 256 };
+    for (int i = 0; i < 3; i++) benchDeliver(members[i], max(1, ops / members[i]));
+    int servers[] = { 3, 32 };
+    for (int i = 0; i < 2; i++) benchPopulate(servers[i], max(1, ops / 10));
+    return 0;
+}
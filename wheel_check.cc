@@ -0,0 +1,155 @@
+// Checks the timer wheel (cs_wheel.h) against the ticks each timer should
+// fire at: deadlines on both sides of every level boundary, random deadlines
+// up to and past WHEEL_MAXSPAN with deletes in between, and timers that are
+// armed again from a last-seen tick the way idle eviction uses them.
+// Prints one line per case: case timers wrong, exits 1 if any is wrong.
+// usage: ./wheel_check [seed]
+#include "cs_wheel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <random>
+
+using namespace std;
+
+struct checkTimer {
+    wheelTimer t;
+    uint64_t want; // tick it has to fire at, 0 if it must not fire
+    uint64_t fired; // tick it did fire at
+    int times;
+    uint64_t lastSeen, timeout; // rearm case
+};
+
+static timerWheel w;
+static mt19937_64 rng;
+static bool failed = false;
+
+static void onFire(void *arg) {
+    checkTimer &c = *(checkTimer*) arg;
+    c.fired = w.now;
+    c.times++;
+}
+
+// what cs_idle.cc does: the timer is only set when the client is first seen,
+// activity moves lastSeen, the timer looks at it when it fires
+static void onExpired(void *arg) {
+    checkTimer &c = *(checkTimer*) arg;
+    uint64_t due = c.lastSeen + c.timeout;
+    if (due > w.now) {
+        wheel_add(w, &c.t, due);
+        return;
+    }
+    c.fired = w.now;
+    c.times++;
+}
+
+static void arm(checkTimer &c, uint64_t expires, void (*fire)(void*)) {
+    c.t.prev = c.t.next = NULL;
+    c.t.fire = fire;
+    c.t.arg = &c;
+    c.fired = c.times = 0;
+    c.want = expires;
+    wheel_add(w, &c.t, expires);
+}
+
+static void report(const char *name, vector<checkTimer> const &timers) {
+    long wrong = 0;
+    for (int i = 0; i < timers.size(); i++) {
+        checkTimer const &c = timers[i];
+        bool ok = c.want == 0 ? c.times == 0 : c.times == 1 && c.fired == c.want;
+        if (ok) continue;
+        if (wrong++ < 3) {
+            fprintf(stderr, "%s: timer %d wants tick %llu, fired %d times, last at %llu\n", name, i,
+                    (unsigned long long) c.want, c.times, (unsigned long long) c.fired);
+        }
+    }
+    printf("%s %d %ld\n", name, (int) timers.size(), wrong);
+    if (wrong > 0) failed = true;
+}
+
+// from a start tick just before, at and after each level's boundary, a
+// deadline just before, at and after the next level's span
+static void levelBoundaries() {
+    vector<checkTimer> timers;
+    vector<pair<uint64_t,uint64_t> > cases; // start tick, deadline
+    for (int l = 1; l < WHEEL_LEVELS; l++) {
+        uint64_t span = 1ULL << (WHEEL_BITS * l);
+        for (int s = -1; s <= 1; s++) {
+            uint64_t start = 3 * span + s;
+            for (int d = -2; d <= 2; d++) {
+                cases.push_back(make_pair(start, start + span + d));
+                cases.push_back(make_pair(start, (start / span + 1) * span + d));
+                cases.push_back(make_pair(start, 5 * span + d)); // lands on a higher slot's edge
+            }
+        }
+    }
+    timers.resize(cases.size());
+    for (int i = 0; i < cases.size(); i++) {
+        wheel_init(w);
+        wheel_advance(w, cases[i].first);
+        arm(timers[i], cases[i].second, onFire);
+        if (cases[i].second <= cases[i].first) timers[i].want = cases[i].first + 1;
+        wheel_advance(w, max(timers[i].want, cases[i].second) + 1);
+    }
+    report("level_boundaries", timers);
+}
+
+// many timers on one wheel, added while it turns, some deleted again;
+// deadlines in the past fire on the next tick, too far ones are clamped
+static void randomDeadlines(int count) {
+    vector<checkTimer> timers(count);
+    wheel_init(w);
+    for (int i = 0; i < count; i++) {
+        if (i % 1000 == 0) wheel_advance(w, w.now + rng() % 5000);
+        int bits = rng() % (WHEEL_BITS * WHEEL_LEVELS + 2);
+        uint64_t span = rng() % (1ULL << bits);
+        uint64_t expires = i % 50 == 0 ? w.now / 2 : w.now + span;
+        arm(timers[i], expires, onFire);
+        if (expires <= w.now) timers[i].want = w.now + 1;
+        else if (expires - w.now > WHEEL_MAXSPAN) timers[i].want = w.now + WHEEL_MAXSPAN;
+        if (i % 7 == 0) {
+            wheel_del(&timers[i].t);
+            timers[i].want = 0;
+        }
+    }
+    // in steps, a timer may fire any time in the middle of one
+    uint64_t end = w.now + WHEEL_MAXSPAN + 1;
+    while (w.now < end) wheel_advance(w, w.now + rng() % 100000);
+    report("random_deadlines", timers);
+}
+
+// activity at random ticks after the timer was set; it has to fire exactly
+// one timeout after the last activity, however often it was put back
+static void rearmFromLastSeen(int count) {
+    static const uint64_t timeouts[] = { 1, 63, 64, 100, 4095, 4096, 5000, 300000 };
+    vector<checkTimer> timers(count);
+    wheel_init(w);
+    wheel_advance(w, 1000);
+    for (int i = 0; i < count; i++) {
+        checkTimer &c = timers[i];
+        c.timeout = timeouts[i % (sizeof(timeouts) / sizeof(timeouts[0]))];
+        c.lastSeen = w.now;
+        arm(c, w.now + c.timeout, onExpired);
+    }
+    uint64_t end = w.now + 4 * 300000;
+    while (w.now < end) {
+        wheel_advance(w, w.now + 1 + rng() % 200);
+        for (int k = 0; k < 20; k++) {
+            checkTimer &c = timers[rng() % count];
+            // seen again before it timed out, on the tick the wheel is at
+            if (c.times == 0 && w.now - c.lastSeen < c.timeout && w.now < end - 300000) c.lastSeen = w.now;
+        }
+    }
+    for (int i = 0; i < count; i++) timers[i].want = timers[i].lastSeen + timers[i].timeout;
+    report("rearm_last_seen", timers);
+}
+
+int main(int argc, char *argv[])
+{
+    rng.seed(argc > 1 ? atoi(argv[1]) : 1);
+    printf("case timers wrong\n");
+    levelBoundaries();
+    randomDeadlines(200000);
+    rearmFromLastSeen(20000);
+    return failed ? 1 : 0;
+}